@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "command.h"
+#include "config.h"
+
+slapt_src_command *slapt_src_command_init(const char *program)
+{
+    slapt_src_command *command = slapt_malloc(sizeof *command);
+    command->argv = slapt_vector_t_init(free);
+    command->env = slapt_vector_t_init(free);
+    command->line = strdup("");
+    command->cwd = NULL;
+    command->log = NULL;
+    command->echo = true;
+    slapt_src_command_add(command, program);
+    return command;
+}
+
+void slapt_src_command_free(slapt_src_command *command)
+{
+    slapt_vector_t_free(command->argv);
+    slapt_vector_t_free(command->env);
+    free(command->line);
+    if (command->cwd != NULL)
+        free(command->cwd);
+    if (command->log != NULL)
+        free(command->log);
+    free(command);
+}
+
+void slapt_src_command_add(slapt_src_command *command, const char *arg)
+{
+    slapt_vector_t_add(command->argv, strdup(arg));
+
+    const size_t len = strlen(command->line) + strlen(arg) + 2;
+    char *line = slapt_malloc(len);
+    snprintf(line, len, "%s%s%s", command->line, command->line[0] != '\0' ? " " : "", arg);
+    free(command->line);
+    command->line = line;
+}
+
+/* index of name in env, -1 if it is not there */
+static int env_find(const slapt_vector_t *env, const char *name)
+{
+    const size_t name_len = strlen(name);
+    for (uint32_t i = 0; i < env->size; i++) {
+        const char *entry = env->items[i];
+        if (strncmp(entry, name, name_len) == 0 && entry[name_len] == '=')
+            return (int)i;
+    }
+    return -1;
+}
+
+void slapt_src_command_setenv(slapt_src_command *command, const char *name, const char *value)
+{
+    const size_t len = strlen(name) + strlen(value) + 2;
+    char *entry = slapt_malloc(len);
+    snprintf(entry, len, "%s=%s", name, value);
+
+    const int i = env_find(command->env, name);
+    if (i == -1) {
+        slapt_vector_t_add(command->env, entry);
+    } else {
+        free(command->env->items[i]);
+        command->env->items[i] = entry;
+    }
+}
+
+const char *slapt_src_command_getenv(const slapt_src_command *command, const char *name)
+{
+    const int i = env_find(command->env, name);
+    if (i == -1)
+        return getenv(name);
+    const char *entry = command->env->items[i];
+    return entry + strlen(name) + 1;
+}
+
+void slapt_src_command_set_cwd(slapt_src_command *command, const char *cwd)
+{
+    if (command->cwd != NULL)
+        free(command->cwd);
+    command->cwd = strdup(cwd);
+}
+
+void slapt_src_command_set_log(slapt_src_command *command, const char *log)
+{
+    if (command->log != NULL)
+        free(command->log);
+    command->log = strdup(log);
+}
+
+/* environ with command->env on top, the strings are borrowed from both */
+static char **command_environ(const slapt_src_command *command)
+{
+    uint32_t count = 0;
+    while (environ[count] != NULL)
+        count++;
+
+    char **envp = slapt_malloc(sizeof *envp * (count + command->env->size + 1));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const char *eq = strchr(environ[i], '=');
+        bool replaced = false;
+        slapt_vector_t_foreach (const char *, entry, command->env) {
+            const size_t name_len = (size_t)(strchr(entry, '=') - entry);
+            if (eq != NULL && (size_t)(eq - environ[i]) == name_len && strncmp(environ[i], entry, name_len) == 0) {
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced)
+            envp[n++] = environ[i];
+    }
+    slapt_vector_t_foreach (char *, entry, command->env)
+        envp[n++] = entry;
+    envp[n] = NULL;
+    return envp;
+}
+
+/* the last SLAPT_SRC_COMMAND_TAIL bytes written */
+typedef struct _slapt_src_command_tail_ {
+    char data[SLAPT_SRC_COMMAND_TAIL];
+    size_t end;
+    bool wrapped;
+} slapt_src_command_tail;
+
+static void tail_add(slapt_src_command_tail *tail, const char *data, size_t len)
+{
+    if (len >= SLAPT_SRC_COMMAND_TAIL) {
+        data += len - SLAPT_SRC_COMMAND_TAIL;
+        len = SLAPT_SRC_COMMAND_TAIL;
+    }
+
+    const size_t first = len < SLAPT_SRC_COMMAND_TAIL - tail->end ? len : SLAPT_SRC_COMMAND_TAIL - tail->end;
+    memcpy(tail->data + tail->end, data, first);
+    memcpy(tail->data, data + first, len - first);
+    if (tail->end + len >= SLAPT_SRC_COMMAND_TAIL)
+        tail->wrapped = true;
+    tail->end = (tail->end + len) % SLAPT_SRC_COMMAND_TAIL;
+}
+
+/* from the first whole line once older output has been dropped */
+static void tail_print(const slapt_src_command_tail *tail)
+{
+    if (!tail->wrapped) {
+        fwrite(tail->data, 1, tail->end, stdout);
+        return;
+    }
+
+    size_t start = tail->end;
+    const char *newline = memchr(tail->data + start, '\n', SLAPT_SRC_COMMAND_TAIL - start);
+    if (newline != NULL) {
+        start = (size_t)(newline - tail->data) + 1;
+        fwrite(tail->data + start, 1, SLAPT_SRC_COMMAND_TAIL - start, stdout);
+        fwrite(tail->data, 1, tail->end, stdout);
+    } else {
+        newline = memchr(tail->data, '\n', tail->end);
+        start = newline != NULL ? (size_t)(newline - tail->data) + 1 : 0;
+        fwrite(tail->data + start, 1, tail->end - start, stdout);
+    }
+}
+
+int slapt_src_command_run(const slapt_src_command *command)
+{
+    int out[2], err[2];
+    if (pipe2(out, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    if (pipe2(err, O_CLOEXEC) != 0) {
+        perror("pipe");
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (command->cwd != NULL)
+        posix_spawn_file_actions_addchdir_np(&actions, command->cwd);
+    if (!command->echo)
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+
+    /* slapt-src ignores SIGPIPE, the command should not */
+    posix_spawnattr_t attr;
+    sigset_t sigdefault;
+    posix_spawnattr_init(&attr);
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    char **argv = slapt_malloc(sizeof *argv * (command->argv->size + 1));
+    for (uint32_t i = 0; i < command->argv->size; i++)
+        argv[i] = command->argv->items[i];
+    argv[command->argv->size] = NULL;
+    char **envp = command_environ(command);
+
+    /* what was printed so far comes before anything the command prints */
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = 0;
+    const int spawn_r = posix_spawnp(&pid, argv[0], &actions, &attr, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(out[1]);
+    close(err[1]);
+    free(envp);
+    free(argv);
+    if (spawn_r != 0) {
+        fprintf(stderr, "%s: %s\n", command->line, strerror(spawn_r));
+        close(out[0]);
+        close(err[0]);
+        return -1;
+    }
+
+    FILE *log = NULL;
+    if (command->log != NULL && (log = fopen(command->log, "a")) == NULL)
+        fprintf(stderr, gettext("Failed to open %s: %s\n"), command->log, strerror(errno));
+
+    slapt_src_command_tail *tail = slapt_malloc(sizeof *tail);
+    tail->end = 0;
+    tail->wrapped = false;
+
+    /* stdout and stderr are echoed to ours, and go into the log together as they arrive */
+    struct pollfd fds[2] = {{.fd = out[0], .events = POLLIN}, {.fd = err[0], .events = POLLIN}};
+    int echo_fd[2] = {command->echo ? STDOUT_FILENO : -1, command->echo ? STDERR_FILENO : -1};
+    uint32_t open_fds = 2;
+    char buffer[4096];
+    while (open_fds > 0) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (uint32_t i = 0; i < 2; i++) {
+            if (fds[i].fd == -1 || fds[i].revents == 0)
+                continue;
+
+            const ssize_t r = read(fds[i].fd, buffer, sizeof buffer);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_fds--;
+                continue;
+            }
+
+            /* with SIGPIPE ignored a closed stdout or stderr is EPIPE here, the
+               command keeps running and its output still goes to the log */
+            if (echo_fd[i] != -1 && write(echo_fd[i], buffer, (size_t)r) == -1 && errno == EPIPE)
+                echo_fd[i] = -1;
+            if (log != NULL)
+                fwrite(buffer, 1, (size_t)r, log);
+            tail_add(tail, buffer, (size_t)r);
+        }
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        if (fds[i].fd != -1)
+            close(fds[i].fd);
+    }
+    if (log != NULL)
+        fclose(log);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            status = -1;
+            break;
+        }
+    }
+
+    if (status != 0) {
+        if (!command->echo) {
+            printf(gettext("Last output of %s:\n"), command->line);
+            tail_print(tail);
+        }
+        if (command->log != NULL)
+            printf(gettext("The complete output of %s is in %s\n"), command->line, command->log);
+    }
+
+    free(tail);
+    return status;
+}
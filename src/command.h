@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <slapt.h>
+#ifndef __SLAPT_SRC_COMMAND_H__
+#define __SLAPT_SRC_COMMAND_H__
+
+/* bytes of the most recent output kept, shown when a command without echo fails */
+#define SLAPT_SRC_COMMAND_TAIL (16 * 1024)
+
+/*
+ * a program run with posix_spawn, in its own directory and with its own
+ * additions to the environment, rather than through system() and whatever
+ * the process has chdir'd to or setenv'd.  Its stdout and stderr come back
+ * through pipes of their own, appended to log together when there is one
+ * and echoed to our stdout and stderr when echo is set.
+ */
+typedef struct _slapt_src_command_ {
+    slapt_vector_t *argv;
+    slapt_vector_t *env; /* NAME=value, over the inherited environment */
+    char *line;          /* argv joined, for messages */
+    char *cwd;           /* NULL for the current directory */
+    char *log;           /* NULL for none */
+    bool echo;           /* when false stdin is /dev/null too */
+} slapt_src_command;
+slapt_src_command *slapt_src_command_init(const char *program);
+void slapt_src_command_free(slapt_src_command *);
+void slapt_src_command_add(slapt_src_command *, const char *arg);
+void slapt_src_command_setenv(slapt_src_command *, const char *name, const char *value);
+/* the value given to slapt_src_command_setenv, or inherited, NULL if neither */
+const char *slapt_src_command_getenv(const slapt_src_command *, const char *name);
+void slapt_src_command_set_cwd(slapt_src_command *, const char *cwd);
+void slapt_src_command_set_log(slapt_src_command *, const char *log);
+/*
+ * runs the command to completion, returning its wait status, 0 on success
+ * and -1 when it could not be started.  On failure the end of its output is
+ * shown unless it was echoed, along with where the log is.
+ */
+int slapt_src_command_run(const slapt_src_command *);
+
+#endif
@@ -17,6 +17,7 @@
  */
 
 #define _GNU_SOURCE
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,13 +27,17 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <config.h>
+#include "command.h"
 #include "source.h"
+#include "scheduler.h"
+#include "stats.h"
 
 #define BUILD_ONLY_FLAG 1
 #define FETCH_ONLY_FLAG 2
 
 static int show_summary(slapt_vector_t *, slapt_vector_t *, int, bool);
 static void clean(slapt_src_config *config);
+static void build_parallel(slapt_src_config *config, const slapt_src_catalog *catalog, slapt_vector_t *sbs, slapt_vector_t *names, int action, slapt_src_jobserver *jobserver);
 
 void version(void)
 {
@@ -78,6 +83,9 @@ void help(void)
     printf("  -B, --build-only       %s\n", gettext("applicable only to --upgrade-all"));
     printf("  -F, --fetch-only       %s\n", gettext("applicable only to --upgrade-all"));
     printf("  -S, --skip-installable %s\n", gettext("skip if available via slapt-get, applicable only to --upgrade-all"));
+    printf("  -j, --jobs=N           %s\n", gettext("build up to N independent slackbuilds at once"));
+    printf("  -I, --case-insensitive %s\n", gettext("ignore case, applicable only to --search"));
+    printf("  --stats[=json]         %s\n", gettext("report time and I/O spent per phase and slackbuild on exit"));
 }
 
 #define VERSION_OPT 'v'
@@ -99,6 +107,9 @@ void help(void)
 #define BUILD_ONLY_OPT 'B'
 #define FETCH_ONLY_OPT 'F'
 #define SKIP_INSTALLABLE_PKGS_OPT 'S'
+#define JOBS_OPT 'j'
+#define CASE_INSENSITIVE_OPT 'I'
+#define STATS_OPT 'R'
 
 struct utsname uname_v; /* for .machine */
 
@@ -128,6 +139,8 @@ int main(int argc, char *argv[])
         {"b", required_argument, 0, BUILD_OPT},
         {"build-only", no_argument, 0, BUILD_ONLY_OPT},
         {"B", no_argument, 0, BUILD_ONLY_OPT},
+        {"case-insensitive", no_argument, 0, CASE_INSENSITIVE_OPT},
+        {"I", no_argument, 0, CASE_INSENSITIVE_OPT},
         {"clean", no_argument, 0, CLEAN_OPT},
         {"e", no_argument, 0, CLEAN_OPT},
         {"config", required_argument, 0, CONFIG_OPT},
@@ -138,6 +151,8 @@ int main(int argc, char *argv[])
         {"F", no_argument, 0, FETCH_ONLY_OPT},
         {"help", no_argument, 0, HELP_OPT},
         {"install", required_argument, 0, INSTALL_OPT},
+        {"jobs", required_argument, 0, JOBS_OPT},
+        {"j", required_argument, 0, JOBS_OPT},
         {"list", no_argument, 0, LIST_OPT},
         {"no-dep", no_argument, 0, NODEP_OPT},
         {"postprocess", required_argument, 0, POSTCMD_OPT},
@@ -149,6 +164,7 @@ int main(int argc, char *argv[])
         {"w", required_argument, 0, SHOW_OPT},
         {"simulate", no_argument, 0, SIMULATE_OPT},
         {"t", no_argument, 0, SIMULATE_OPT},
+        {"stats", optional_argument, 0, STATS_OPT},
         {"update", no_argument, 0, UPDATE_OPT},
         {"u", no_argument, 0, UPDATE_OPT},
         {"upgrade-all", no_argument, 0, UPGRADE_OPT},
@@ -159,6 +175,8 @@ int main(int argc, char *argv[])
 
     /* initialization */
     setbuf(stdout, NULL);
+    /* a write to a pipe whose reader is gone fails with EPIPE instead, commands run get the default back */
+    signal(SIGPIPE, SIG_IGN);
 #ifdef ENABLE_NLS
     setlocale(LC_ALL, "");
     textdomain(GETTEXT_PACKAGE);
@@ -179,7 +197,8 @@ int main(int argc, char *argv[])
     }
 
     int only_flags = 0;
-    bool prompt = true, do_dep = true, simulate = false, skip_installable_pkgs = false;
+    uint32_t jobs = 1, search_flags = 0;
+    bool prompt = true, do_dep = true, simulate = false, skip_installable_pkgs = false, stats = false, stats_json = false;
     char *config_file = NULL, *postcmd = NULL;
     slapt_vector_t *names = slapt_vector_t_init(free);
     int c = -1, option_index = 0, action = 0;
@@ -247,12 +266,35 @@ int main(int argc, char *argv[])
         case SKIP_INSTALLABLE_PKGS_OPT:
             skip_installable_pkgs = true;
             break;
+        case JOBS_OPT: {
+            char *end = NULL;
+            const unsigned long n = strtoul(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || n == 0 || n > UINT32_MAX) {
+                fprintf(stderr, gettext("Invalid number of jobs: %s\n"), optarg);
+                exit(EXIT_FAILURE);
+            }
+            jobs = (uint32_t)n;
+        } break;
+        case CASE_INSENSITIVE_OPT:
+            search_flags |= SLAPT_SRC_SEARCH_CASE_INSENSITIVE;
+            break;
+        case STATS_OPT:
+            if (optarg != NULL && strcmp(optarg, "json") != 0) {
+                fprintf(stderr, gettext("Invalid stats format: %s\n"), optarg);
+                exit(EXIT_FAILURE);
+            }
+            stats = true;
+            stats_json = optarg != NULL;
+            break;
         default:
             help();
             exit(EXIT_FAILURE);
         }
     }
 
+    if (stats)
+        slapt_src_stats_init(stats_json);
+
     if ((action == UPGRADE_OPT) && (optind < argc)) {
         fprintf(stderr, gettext("Individual packages not accepted when upgrading all slackbuilds\n"));
         exit(EXIT_FAILURE);
@@ -283,6 +325,7 @@ int main(int argc, char *argv[])
     config->do_dep = do_dep;
     config->prompt = prompt;
     config->postcmd = postcmd; /* to be freed in slapt_src_config_free */
+    config->jobs = jobs;
 
     init_builddir(config);
     if ((chdir(config->builddir)) != 0) {
@@ -291,7 +334,7 @@ int main(int argc, char *argv[])
     }
 
     slapt_vector_t *sbs = NULL;
-    slapt_vector_t *remote_sbs = NULL;
+    slapt_src_catalog *catalog = NULL;
     slapt_vector_t *installed = NULL;
     slapt_vector_t *available = NULL;
 
@@ -302,20 +345,30 @@ int main(int argc, char *argv[])
         break; /* nothing to do here */
     case LIST_OPT:
     case SEARCH_OPT:
-    case SHOW_OPT:
-        remote_sbs = slapt_src_get_available_slackbuilds();
-        break;
+    case SHOW_OPT: {
+        slapt_src_stats_sample sample;
+        slapt_src_stats_start(&sample);
+        catalog = slapt_src_get_available_slackbuilds();
+        slapt_src_stats_stop(&sample, "catalog", NULL);
+    } break;
     case FETCH_OPT:
     case BUILD_OPT:
     case INSTALL_OPT:
-    case UPGRADE_OPT:
-        remote_sbs = slapt_src_get_available_slackbuilds();
+    case UPGRADE_OPT: {
+        slapt_src_stats_sample sample;
+        slapt_src_stats_start(&sample);
+        catalog = slapt_src_get_available_slackbuilds();
+        slapt_src_stats_stop(&sample, "catalog", NULL);
+        slapt_src_stats_start(&sample);
         installed = slapt_get_installed_pkgs();
+        slapt_src_stats_stop(&sample, "installed", NULL);
 
         if (skip_installable_pkgs) {
             slapt_config_t *slapt_config = slapt_config_t_read(RC_DIR "/slapt-getrc");
             if ((chdir(slapt_config->working_dir)) == 0) {
+                slapt_src_stats_start(&sample);
                 available = slapt_get_available_pkgs();
+                slapt_src_stats_stop(&sample, "available", NULL);
                 if ((chdir(config->builddir)) != 0) {
                     perror(gettext("Failed to chdir to build directory"));
                     exit(EXIT_FAILURE);
@@ -327,39 +380,41 @@ int main(int argc, char *argv[])
         }
 
         /* convert all names to slackbuilds */
+        slapt_src_stats_start(&sample);
         if (names->size > 0) {
-            sbs = slapt_src_names_to_slackbuilds(config, remote_sbs, names, installed);
+            sbs = slapt_src_names_to_slackbuilds(config, catalog, names, installed);
             if (sbs == NULL || sbs->size == 0) {
                 printf(gettext("Unable to find all specified slackbuilds.\n"));
                 exit(EXIT_FAILURE);
             }
         } else if (action == UPGRADE_OPT) {
-            /* for each entry in 'installed' see if it's available as a slackbuild */
-            slapt_vector_t_foreach(const slapt_pkg_t *, pkg, installed) {
-                slapt_vector_t *matches = slapt_vector_t_search(remote_sbs, sb_compare_pkg_to_name, pkg->name);
-                if (!matches) {
-                    continue;
-                }
-                slapt_vector_t_foreach(const slapt_src_slackbuild *, upgrade_sb, matches) {
-                    if (slapt_pkg_t_cmp_versions(upgrade_sb->version, pkg->version) == 1) {
-                        // optionally skip packages that come from slapt-get
-                        if (skip_installable_pkgs) {
-                            if (slapt_get_newest_pkg(available, pkg->name)) {
-                                continue;
-                            }
-                        }
-                        slapt_vector_t_add(names, strdup(upgrade_sb->name));
+            /* for each entry in 'installed' see if a newer slackbuild is available */
+            slapt_vector_t *upgrades = slapt_src_get_upgrades(catalog, installed);
+            const slapt_src_slackbuild *last_upgrade_sb = NULL;
+            slapt_vector_t_foreach(const slapt_src_upgrade *, upgrade, upgrades) {
+                // optionally skip packages that come from slapt-get
+                if (skip_installable_pkgs) {
+                    if (slapt_get_newest_pkg(available, upgrade->installed->name)) {
+                        continue;
                     }
                 }
-                slapt_vector_t_free(matches);
+                /* upgrades are in name order, multiple installed versions share a slackbuild */
+                if (upgrade->slackbuild == last_upgrade_sb) {
+                    continue;
+                }
+                last_upgrade_sb = upgrade->slackbuild;
+                slapt_vector_t_add(names, strdup(upgrade->slackbuild->name));
             }
+            slapt_vector_t_free(upgrades);
 
-            sbs = slapt_src_names_to_slackbuilds(config, remote_sbs, names, installed);
+            sbs = slapt_src_names_to_slackbuilds(config, catalog, names, installed);
         }
+        slapt_src_stats_stop(&sample, "resolve", NULL);
+
         /* provide summary */
         if (!simulate)
             action = show_summary(sbs, names, action, prompt);
-        break;
+    } break;
     default:
         help();
         exit(EXIT_FAILURE);
@@ -380,12 +435,33 @@ int main(int argc, char *argv[])
         }
     }
 
+    /* building one at a time fetches ahead of each build in the background,
+       otherwise the scheduler gets the whole set downloaded up front, in parallel */
+    slapt_src_prefetch *prefetch = NULL;
+    const bool scheduled = config->jobs > 1 || config->adaptive;
+    if (!simulate && sbs != NULL && (action == BUILD_OPT || action == INSTALL_OPT) && !scheduled)
+        prefetch = slapt_src_prefetch_start(config, sbs);
+    else if (!simulate && sbs != NULL && (action == FETCH_OPT || action == BUILD_OPT || action == INSTALL_OPT)) {
+        slapt_src_stats_sample sample;
+        slapt_src_stats_start(&sample);
+        slapt_src_fetch_slackbuilds(config, sbs);
+        slapt_src_stats_stop(&sample, "fetch", NULL);
+    }
+
+    /* every make in every build shares one pool of jobs */
+    slapt_src_jobserver *jobserver = NULL;
+    if (!simulate && sbs != NULL && (action == BUILD_OPT || action == INSTALL_OPT))
+        jobserver = slapt_src_jobserver_init(config);
+
     /* now, actually do what was requested */
     switch (action) {
-    case UPDATE_OPT:
+    case UPDATE_OPT: {
+        slapt_src_stats_sample sample;
+        slapt_src_stats_start(&sample);
         if (!slapt_src_update_slackbuild_cache(config))
             exit(EXIT_FAILURE);
-        break;
+        slapt_src_stats_stop(&sample, "update", NULL);
+    } break;
 
     case FETCH_OPT:
         ;
@@ -396,14 +472,19 @@ int main(int argc, char *argv[])
                 printf(gettext("FETCH: %s\n"), fetch_sb->name);
                 continue;
             } else
-                slapt_src_fetch_slackbuild(config, fetch_sb);
+                slapt_src_show_slackbuild_readme(config, catalog, fetch_sb);
         }
         config->prompt = old_prompt;
         break;
 
     case BUILD_OPT:
         ;
-        slapt_vector_t_foreach(slapt_src_slackbuild *, build_sb, sbs) {
+        if (!simulate && scheduled) {
+            build_parallel(config, catalog, sbs, names, action, jobserver);
+            break;
+        }
+        for (uint32_t i = 0; i < sbs->size; i++) {
+            const slapt_src_slackbuild *build_sb = sbs->items[i];
             const size_t nv_len = strlen(build_sb->name) + strlen(build_sb->version) + 2;
             char namever[nv_len];
             const int r = snprintf(namever, nv_len, "%s:%s", build_sb->name, build_sb->version);
@@ -416,7 +497,12 @@ int main(int argc, char *argv[])
                 continue;
             }
 
-            if (!slapt_src_fetch_slackbuild(config, build_sb))
+            slapt_src_stats_sample sample;
+            slapt_src_stats_start(&sample);
+            if (!slapt_src_prefetch_wait(prefetch, i))
+                exit(EXIT_FAILURE);
+            slapt_src_stats_stop(&sample, "fetch", build_sb->name);
+            if (!slapt_src_show_slackbuild_readme(config, catalog, build_sb))
                 exit(EXIT_FAILURE);
             slapt_src_build_slackbuild(config, build_sb);
 
@@ -436,13 +522,23 @@ int main(int argc, char *argv[])
 
     case INSTALL_OPT:
         ;
-        slapt_vector_t_foreach(slapt_src_slackbuild *, install_sb, sbs) {
+        if (!simulate && scheduled) {
+            build_parallel(config, catalog, sbs, names, action, jobserver);
+            break;
+        }
+        for (uint32_t i = 0; i < sbs->size; i++) {
+            const slapt_src_slackbuild *install_sb = sbs->items[i];
             if (simulate) {
                 printf(gettext("INSTALL: %s\n"), install_sb->name);
                 continue;
             }
 
-            if (!slapt_src_fetch_slackbuild(config, install_sb))
+            slapt_src_stats_sample sample;
+            slapt_src_stats_start(&sample);
+            if (!slapt_src_prefetch_wait(prefetch, i))
+                exit(EXIT_FAILURE);
+            slapt_src_stats_stop(&sample, "fetch", install_sb->name);
+            if (!slapt_src_show_slackbuild_readme(config, catalog, install_sb))
                 exit(EXIT_FAILURE);
             slapt_src_build_slackbuild(config, install_sb);
             slapt_src_install_slackbuild(config, install_sb);
@@ -451,7 +547,7 @@ int main(int argc, char *argv[])
 
     case SEARCH_OPT: {
         ;
-        slapt_vector_t *search = slapt_src_search_slackbuild_cache(remote_sbs, names);
+        slapt_vector_t *search = slapt_src_search_slackbuild_cache(catalog, names, search_flags);
         slapt_vector_t_foreach(slapt_src_slackbuild *, search_sb, search) {
             printf("%s:%s - %s\n",
                    search_sb->name,
@@ -463,7 +559,7 @@ int main(int argc, char *argv[])
 
     case LIST_OPT:
         ;
-        slapt_vector_t_foreach(slapt_src_slackbuild *, list_sb, remote_sbs) {
+        slapt_vector_t_foreach(slapt_src_slackbuild *, list_sb, catalog->slackbuilds) {
             printf("%s:%s - %s\n",
                    list_sb->name,
                    list_sb->version,
@@ -481,7 +577,7 @@ int main(int argc, char *argv[])
             if (parts->size > 1)
                 ver = parts->items[1];
 
-            const slapt_src_slackbuild *sb = slapt_src_get_slackbuild(remote_sbs, name, ver);
+            const slapt_src_slackbuild *sb = slapt_src_get_slackbuild(catalog, name, ver);
 
             if (sb != NULL) {
                 printf(gettext("SlackBuild Name: %s\n"), sb->name);
@@ -513,12 +609,16 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    if (jobserver != NULL)
+        slapt_src_jobserver_free(jobserver);
+    if (prefetch != NULL)
+        slapt_src_prefetch_free(prefetch);
     if (names != NULL)
         slapt_vector_t_free(names);
     if (sbs != NULL)
         slapt_vector_t_free(sbs);
-    if (remote_sbs != NULL)
-        slapt_vector_t_free(remote_sbs);
+    if (catalog != NULL)
+        slapt_src_catalog_free(catalog);
     if (installed != NULL)
         slapt_vector_t_free(installed);
     if (available != NULL)
@@ -605,6 +705,46 @@ static int show_summary(slapt_vector_t *sbs, slapt_vector_t *names, int action,
     return action;
 }
 
+/* same semantics as the sequential loops, but independent slackbuilds build side by side */
+static void build_parallel(slapt_src_config *config, const slapt_src_catalog *catalog, slapt_vector_t *sbs, slapt_vector_t *names, int action, slapt_src_jobserver *jobserver)
+{
+    bool *install = calloc(sbs->size + 1, sizeof *install);
+    if (install == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < sbs->size; i++) {
+        const slapt_src_slackbuild *sb = sbs->items[i];
+
+        /* READMEs and their prompts come first, before any worker starts */
+        if (!slapt_src_show_slackbuild_readme(config, catalog, sb))
+            exit(EXIT_FAILURE);
+
+        if (action == INSTALL_OPT) {
+            install[i] = true;
+            continue;
+        }
+
+        /* XXX we assume if we didn't request the slackbuild, then it is a dependency, and needs to be installed */
+        char *namever = slapt_malloc(sizeof *namever * (strlen(sb->name) + strlen(sb->version) + 2));
+        sprintf(namever, "%s:%s", sb->name, sb->version);
+        slapt_vector_t *name_matches = slapt_vector_t_search(names, sb_compare_name_to_name, sb->name);
+        slapt_vector_t *namever_matches = slapt_vector_t_search(names, sb_compare_name_to_name, namever);
+        install[i] = name_matches == NULL && namever_matches == NULL;
+        if (name_matches)
+            slapt_vector_t_free(name_matches);
+        if (namever_matches)
+            slapt_vector_t_free(namever_matches);
+        free(namever);
+    }
+
+    const bool ok = slapt_src_build_slackbuilds(config, catalog, sbs, install, jobserver);
+    free(install);
+    if (!ok)
+        exit(EXIT_FAILURE);
+}
+
 static void clean(slapt_src_config *config)
 {
     struct dirent *file = NULL;
@@ -620,14 +760,14 @@ static void clean(slapt_src_config *config)
                 continue;
 
             if (S_ISDIR(stat_buf.st_mode)) {
-                const size_t command_len = strlen(file->d_name) + 8;
-                char command[command_len];
-                const int r = snprintf(command, command_len, "rm -rf %s", file->d_name);
-                if (r <= 0 || (size_t)r + 1 == command_len) {
-                    int sys_r = system(command);
-                    if (sys_r != 0)
-                        exit(EXIT_FAILURE);
-                }
+                slapt_src_command *command = slapt_src_command_init("rm");
+                slapt_src_command_add(command, "-rf");
+                slapt_src_command_add(command, "--");
+                slapt_src_command_add(command, file->d_name);
+                command->echo = true;
+                if (slapt_src_command_run(command) != 0)
+                    exit(EXIT_FAILURE);
+                slapt_src_command_free(command);
             }
         }
         closedir(builddir);
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "scheduler.h"
+#include "config.h"
+
+/* how often a scheduler waiting on a token looks for one coming back */
+#define SLAPT_SRC_JOBSERVER_POLL_MS 250
+
+struct _slapt_src_jobserver_ {
+    int fd;         /* read and written by every make, inherited by the builds */
+    int acquire_fd; /* the scheduler's own, non blocking, read side */
+};
+
+/*
+ * the pipe is a fifo opened twice, so the scheduler can read it without
+ * blocking while the makes sharing it keep the blocking reads they expect.
+ * MAKEFLAGS passes the descriptors as R,W, which make has understood since
+ * 4.2, unlike the fifo: form added in 4.4.
+ */
+slapt_src_jobserver *slapt_src_jobserver_init(const slapt_src_config *config)
+{
+    if (config->make_jobs == 0)
+        return NULL;
+
+    char path[64];
+    snprintf(path, sizeof path, ".slapt-src-jobserver.%ld", (long)getpid());
+    unlink(path);
+    if (mkfifo(path, 0600) != 0) {
+        perror("mkfifo");
+        exit(EXIT_FAILURE);
+    }
+
+    slapt_src_jobserver *jobserver = slapt_malloc(sizeof *jobserver);
+    jobserver->fd = open(path, O_RDWR);
+    jobserver->acquire_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    unlink(path);
+    if (jobserver->fd == -1 || jobserver->acquire_fd == -1) {
+        perror("open");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 1; i < config->make_jobs; i++) {
+        if (write(jobserver->fd, "+", 1) != 1) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const char *makeflags = getenv("MAKEFLAGS");
+    const size_t len = (makeflags != NULL ? strlen(makeflags) : 0) + 64;
+    char *flags = slapt_malloc(len);
+    snprintf(flags, len, "%s -j%u --jobserver-auth=%d,%d", makeflags != NULL ? makeflags : "", config->make_jobs, jobserver->fd, jobserver->fd);
+    setenv("MAKEFLAGS", flags, 1);
+    free(flags);
+
+    return jobserver;
+}
+
+void slapt_src_jobserver_free(slapt_src_jobserver *jobserver)
+{
+    close(jobserver->acquire_fd);
+    close(jobserver->fd);
+    free(jobserver);
+}
+
+static bool jobserver_acquire(slapt_src_jobserver *jobserver)
+{
+    char token;
+    return read(jobserver->acquire_fd, &token, 1) == 1;
+}
+
+static void jobserver_release(slapt_src_jobserver *jobserver)
+{
+    if (write(jobserver->fd, "+", 1) != 1)
+        perror("write");
+}
+
+/*
+ * adapting to the host: every SLAPT_SRC_ADAPT_INTERVAL seconds the 10 second
+ * averages of /proc/pressure and the load average, per cpu, either narrow or
+ * widen what runs by one step.  narrowing withholds a jobserver token first,
+ * as that slows running builds down, then lowers how many builds may start.
+ * widening undoes those in reverse.  the interval gives the averages time to
+ * follow the last step.
+ */
+#define SLAPT_SRC_ADAPT_INTERVAL 5
+#define SLAPT_SRC_ADAPT_MEMORY_HIGH 10.0
+#define SLAPT_SRC_ADAPT_MEMORY_LOW 1.0
+#define SLAPT_SRC_ADAPT_CPU_HIGH 60.0
+#define SLAPT_SRC_ADAPT_CPU_LOW 20.0
+#define SLAPT_SRC_ADAPT_LOAD_HIGH 1.5
+#define SLAPT_SRC_ADAPT_LOAD_LOW 1.0
+
+typedef struct _slapt_src_adapt_ {
+    uint32_t builds;       /* builds allowed to run at once */
+    uint32_t max_builds;   /* config->jobs */
+    uint32_t withheld;     /* jobserver tokens kept from the makes */
+    uint32_t max_withheld; /* all but the token each make has of its own */
+    uint32_t make_jobs;
+    long cpus;
+    time_t last;
+} slapt_src_adapt;
+
+/* the "some" avg10 of a /proc/pressure file, -1 when the kernel has no PSI */
+static double pressure_avg10(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+
+    double avg10 = -1;
+    char line[256];
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (strncmp(line, "some ", 5) != 0)
+            continue;
+        const char *value = strstr(line, "avg10=");
+        if (value != NULL)
+            avg10 = strtod(value + 6, NULL);
+        break;
+    }
+
+    fclose(f);
+    return avg10;
+}
+
+static void adapt_init(slapt_src_adapt *adapt, const slapt_src_config *config, const slapt_src_jobserver *jobserver)
+{
+    adapt->builds = config->jobs;
+    adapt->max_builds = config->jobs;
+    adapt->withheld = 0;
+    adapt->max_withheld = jobserver != NULL ? config->make_jobs - 1 : 0;
+    adapt->make_jobs = config->make_jobs;
+    adapt->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (adapt->cpus < 1)
+        adapt->cpus = 1;
+    adapt->last = 0;
+}
+
+static void adapt_update(slapt_src_adapt *adapt, slapt_src_jobserver *jobserver)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (adapt->last != 0 && now.tv_sec - adapt->last < SLAPT_SRC_ADAPT_INTERVAL)
+        return;
+    adapt->last = now.tv_sec;
+
+    const double cpu = pressure_avg10("/proc/pressure/cpu");
+    const double memory = pressure_avg10("/proc/pressure/memory");
+    double load = 0;
+    if (getloadavg(&load, 1) != 1)
+        load = 0;
+    const double load_per_cpu = load / (double)adapt->cpus;
+
+    bool narrowed = false, widened = false;
+    if (memory > SLAPT_SRC_ADAPT_MEMORY_HIGH || cpu > SLAPT_SRC_ADAPT_CPU_HIGH || load_per_cpu > SLAPT_SRC_ADAPT_LOAD_HIGH) {
+        if (adapt->withheld < adapt->max_withheld && jobserver_acquire(jobserver)) {
+            adapt->withheld++;
+            narrowed = true;
+        } else if (adapt->builds > 1) {
+            adapt->builds--;
+            narrowed = true;
+        }
+    } else if (memory < SLAPT_SRC_ADAPT_MEMORY_LOW && cpu < SLAPT_SRC_ADAPT_CPU_LOW && load_per_cpu < SLAPT_SRC_ADAPT_LOAD_LOW) {
+        if (adapt->builds < adapt->max_builds) {
+            adapt->builds++;
+            widened = true;
+        } else if (adapt->withheld > 0) {
+            jobserver_release(jobserver);
+            adapt->withheld--;
+            widened = true;
+        }
+    }
+
+    if (!narrowed && !widened)
+        return;
+
+    const uint32_t make_jobs = adapt->make_jobs - adapt->withheld;
+    if (adapt->make_jobs == 0 && narrowed)
+        printf(gettext("Narrowing to %u builds (load %.2f, cpu pressure %.1f%%, memory pressure %.1f%%)\n"),
+               adapt->builds, load, cpu, memory);
+    else if (adapt->make_jobs == 0)
+        printf(gettext("Widening to %u builds (load %.2f, cpu pressure %.1f%%, memory pressure %.1f%%)\n"),
+               adapt->builds, load, cpu, memory);
+    else if (narrowed)
+        printf(gettext("Narrowing to %u builds and %u make jobs (load %.2f, cpu pressure %.1f%%, memory pressure %.1f%%)\n"),
+               adapt->builds, make_jobs, load, cpu, memory);
+    else
+        printf(gettext("Widening to %u builds and %u make jobs (load %.2f, cpu pressure %.1f%%, memory pressure %.1f%%)\n"),
+               adapt->builds, make_jobs, load, cpu, memory);
+}
+
+/* tokens go back to the jobserver once nothing is left to build */
+static void adapt_free(slapt_src_adapt *adapt, slapt_src_jobserver *jobserver)
+{
+    for (; adapt->withheld > 0; adapt->withheld--)
+        jobserver_release(jobserver);
+}
+
+typedef enum {
+    SLAPT_SRC_JOB_PENDING,
+    SLAPT_SRC_JOB_BUILDING,
+    SLAPT_SRC_JOB_BUILT,
+    SLAPT_SRC_JOB_INSTALLING,
+    SLAPT_SRC_JOB_DONE,
+    SLAPT_SRC_JOB_FAILED,
+} slapt_src_job_state;
+
+typedef struct _slapt_src_job_ {
+    const slapt_src_slackbuild *sb;
+    uint32_t position; /* within the catalog, UINT32_MAX if it is not from it */
+    uint32_t first;    /* catalog position of the first record of its name */
+    slapt_src_job_state state;
+    bool install;
+    bool token; /* holds a jobserver token while building */
+    pid_t pid;
+    uint32_t *deps; /* indexes of the jobs this one requires */
+    uint32_t deps_count;
+} slapt_src_job;
+
+/* only requirements within the set matter, anything else is already installed */
+static void job_find_deps(const slapt_src_catalog *catalog, slapt_src_job *jobs, uint32_t count, uint32_t j)
+{
+    if (jobs[j].position == UINT32_MAX)
+        return;
+
+    const slapt_src_catalog_requires *requires = &catalog->requires[jobs[j].position];
+    const slapt_src_catalog_edge *edges = &catalog->edges[requires->first];
+    jobs[j].deps = slapt_malloc(sizeof *jobs[j].deps * (requires->count + 1));
+    for (uint32_t e = 0; e < requires->count; e++) {
+        if (edges[e].target == UINT32_MAX)
+            continue;
+        for (uint32_t i = 0; i < count; i++) {
+            if (i != j && jobs[i].first == edges[e].target) {
+                jobs[j].deps[jobs[j].deps_count++] = i;
+                break;
+            }
+        }
+    }
+}
+
+static bool job_ready(const slapt_src_job *jobs, const slapt_src_job *job)
+{
+    for (uint32_t d = 0; d < job->deps_count; d++) {
+        if (jobs[job->deps[d]].state != SLAPT_SRC_JOB_DONE)
+            return false;
+    }
+    return true;
+}
+
+static pid_t spawn_worker(const slapt_src_config *config, const slapt_src_slackbuild *sb, bool install)
+{
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0) {
+        /* both exit on failure themselves */
+        if (install)
+            slapt_src_install_slackbuild(config, sb);
+        else
+            slapt_src_build_slackbuild(config, sb);
+        _exit(EXIT_SUCCESS);
+    }
+
+    return pid;
+}
+
+static void job_start(const slapt_src_config *config, slapt_src_job *job)
+{
+    if (job->state == SLAPT_SRC_JOB_BUILT) {
+        printf(gettext("Installing %s\n"), job->sb->name);
+        job->pid = spawn_worker(config, job->sb, true);
+        job->state = SLAPT_SRC_JOB_INSTALLING;
+    } else {
+        printf(gettext("Building %s\n"), job->sb->name);
+        job->pid = spawn_worker(config, job->sb, false);
+        job->state = SLAPT_SRC_JOB_BUILDING;
+    }
+}
+
+bool slapt_src_build_slackbuilds(const slapt_src_config *config, const slapt_src_catalog *catalog, const slapt_vector_t *sbs, const bool *install, slapt_src_jobserver *jobserver)
+{
+    const uint32_t count = sbs->size;
+    slapt_src_job *jobs = calloc(count + 1, sizeof *jobs);
+    if (jobs == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        jobs[i].sb = sbs->items[i];
+        jobs[i].position = slapt_src_catalog_position(catalog, jobs[i].sb);
+        jobs[i].first = UINT32_MAX;
+        if (jobs[i].position != UINT32_MAX) {
+            uint32_t name_count = 0;
+            jobs[i].first = slapt_src_catalog_find(catalog, jobs[i].sb->name, &name_count);
+        }
+        jobs[i].state = SLAPT_SRC_JOB_PENDING;
+        jobs[i].install = install[i];
+    }
+    for (uint32_t i = 0; i < count; i++)
+        job_find_deps(catalog, jobs, count, i);
+
+    uint32_t building = 0;
+    bool installing = false, failed = false, waiting = false;
+    slapt_src_adapt adapt;
+    adapt_init(&adapt, config, jobserver);
+    for (;;) {
+        if (config->adaptive)
+            adapt_update(&adapt, jobserver);
+
+        if (!failed) {
+            /* installs run one at a time, earliest in the list first */
+            for (uint32_t i = 0; i < count && !installing; i++) {
+                if (jobs[i].state == SLAPT_SRC_JOB_BUILT) {
+                    job_start(config, &jobs[i]);
+                    installing = true;
+                }
+            }
+
+            for (uint32_t i = 0; i < count && building < adapt.builds; i++) {
+                if (jobs[i].state == SLAPT_SRC_JOB_PENDING && job_ready(jobs, &jobs[i])) {
+                    /* the first build runs on the token every make has of its own */
+                    if (building > 0 && jobserver != NULL) {
+                        if (!jobserver_acquire(jobserver)) {
+                            waiting = true;
+                            break;
+                        }
+                        jobs[i].token = true;
+                    }
+                    job_start(config, &jobs[i]);
+                    building++;
+                }
+            }
+
+            /* only a dependency cycle within the set gets here, fall back to list order */
+            for (uint32_t i = 0; i < count && building == 0 && !installing; i++) {
+                if (jobs[i].state == SLAPT_SRC_JOB_PENDING) {
+                    job_start(config, &jobs[i]);
+                    building++;
+                }
+            }
+        }
+
+        if (building == 0 && !installing)
+            break;
+
+        int status = 0;
+        pid_t pid = 0;
+        if (waiting || config->adaptive) {
+            /* a token may come back from a make before any worker exits,
+               and adapting looks at the host now and then regardless */
+            struct pollfd token = {.fd = waiting ? jobserver->acquire_fd : -1, .events = POLLIN, .revents = 0};
+            poll(&token, 1, SLAPT_SRC_JOBSERVER_POLL_MS);
+            waiting = false;
+            pid = waitpid(-1, &status, WNOHANG);
+            if (pid == 0)
+                continue;
+        } else {
+            pid = waitpid(-1, &status, 0);
+        }
+        if (pid == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("waitpid");
+            exit(EXIT_FAILURE);
+        }
+
+        slapt_src_job *job = NULL;
+        for (uint32_t i = 0; i < count && job == NULL; i++) {
+            if (jobs[i].pid == pid)
+                job = &jobs[i];
+        }
+        if (job == NULL)
+            continue;
+        job->pid = 0;
+
+        const bool ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+        if (job->state == SLAPT_SRC_JOB_BUILDING) {
+            building--;
+            if (job->token) {
+                jobserver_release(jobserver);
+                job->token = false;
+            }
+            job->state = job->install ? SLAPT_SRC_JOB_BUILT : SLAPT_SRC_JOB_DONE;
+        } else {
+            installing = false;
+            job->state = SLAPT_SRC_JOB_DONE;
+        }
+
+        if (!ok) {
+            /* let the running workers finish but start nothing new */
+            job->state = SLAPT_SRC_JOB_FAILED;
+            failed = true;
+        }
+    }
+
+    adapt_free(&adapt, jobserver);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (jobs[i].deps != NULL)
+            free(jobs[i].deps);
+    }
+    free(jobs);
+
+    return !failed;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "source.h"
+#ifndef __SLAPT_SRC_SCHEDULER_H__
+#define __SLAPT_SRC_SCHEDULER_H__
+
+/*
+ * a GNU make jobserver shared by every build: a pipe holding one token per
+ * make job beyond the first, passed to each SlackBuild through MAKEFLAGS.
+ * all makes draw from it, as does the scheduler for each build it runs
+ * beyond the first, so at most config->make_jobs jobs run at once in total.
+ * NULL when config->make_jobs is 0.
+ */
+typedef struct _slapt_src_jobserver_ slapt_src_jobserver;
+slapt_src_jobserver *slapt_src_jobserver_init(const slapt_src_config *config);
+void slapt_src_jobserver_free(slapt_src_jobserver *jobserver);
+
+/*
+ * build the already fetched sbs with up to config->jobs worker processes,
+ * starting each as soon as the slackbuilds it requires within sbs are done.
+ * sbs are records of catalog, whose REQUIRES edges give the ordering.
+ * sbs[i] is installed after building when install[i] is set, installs run
+ * one at a time. with a jobserver, every build beyond the first also needs
+ * one of its tokens. returns false once any build or install failed and the
+ * running workers have finished.
+ */
+bool slapt_src_build_slackbuilds(const slapt_src_config *config, const slapt_src_catalog *catalog, const slapt_vector_t *sbs, const bool *install, slapt_src_jobserver *jobserver);
+
+#endif
@@ -17,25 +17,111 @@
  */
 
 #define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <openssl/evp.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#include <pthread.h>
+#include <signal.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include "command.h"
 #include "source.h"
+#include "stats.h"
+#include "transfer.h"
 #include "config.h"
 
 #ifdef HAS_FAKEROOT
-#define SLAPTSRC_CMD_LEN 27
 #define SLAPTSRC_CMD "fakeroot -- sh"
-#define SLAPTSRC_SLKBUILD_CMD_LEN 24
 #define SLAPTSRC_SLKBUILD_CMD "fakeroot -- slkbuild -X"
 #else
-#define SLAPTSRC_CMD_LEN 15
 #define SLAPTSRC_CMD "sh"
-#define SLAPTSRC_SLKBUILD_CMD_LEN 12
 #define SLAPTSRC_SLKBUILD_CMD "slkbuild -X"
 #endif
 
+#define SLAPT_SRC_BUILD_LOG "slapt-src.log"
+
+/*
+ * binary catalog layout, written alongside the text slackbuilds_data:
+ * a header, one fixed width record per slackbuild, the REQUIRES edges of
+ * every record, the search index, then a string table.  record fields are
+ * offsets into the string table, each string is NUL terminated.  The files
+ * of a record are stored back to back, as are its edges.  The search index
+ * is a sorted table of trigrams, each pointing at an ascending run of the
+ * records containing it in their name, location or short description.
+ */
+#define SLAPT_SRC_CATALOG_MAGIC "SLPTSRC"
+#define SLAPT_SRC_CATALOG_VERSION 4
+#define SLAPT_SRC_CATALOG_NULL UINT32_MAX
+#define SLAPT_SRC_CATALOG_HAS_README 0x1u
+#define SLAPT_SRC_CATALOG_HAS_INDEX 0x1u
+
+#define SLAPT_SRC_SEARCH_MAX_THREADS 16
+#define SLAPT_SRC_SEARCH_CHUNK 512 /* records a search thread claims at a time */
+
+typedef struct _slapt_src_catalog_header_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t record_count;
+    uint32_t file_count;
+    uint32_t edge_count;
+    uint32_t trigram_count;
+    uint32_t posting_count;
+    uint32_t strings_size;
+} slapt_src_catalog_header;
+
+typedef struct _slapt_src_catalog_record_ {
+    uint32_t name;
+    uint32_t version;
+    uint32_t location;
+    uint32_t sb_source_url;
+    uint32_t download;
+    uint32_t download_x86_64;
+    uint32_t md5sum;
+    uint32_t md5sum_x86_64;
+    uint32_t sha256sum;
+    uint32_t sha256sum_x86_64;
+    uint32_t short_desc;
+    uint32_t requires;
+    uint32_t files;
+    uint32_t files_count;
+    uint32_t edges;
+    uint32_t edges_count;
+    uint32_t flags;
+} slapt_src_catalog_record;
+
+typedef struct _slapt_src_catalog_strings_ {
+    char *data;
+    uint32_t size;
+    uint32_t capacity;
+} slapt_src_catalog_strings;
+
+typedef struct _slapt_src_u32_array_ {
+    uint32_t *items;
+    uint32_t size;
+    uint32_t capacity;
+} slapt_src_u32_array;
+
 extern struct utsname uname_v;
 
 static char *filename_from_url(char *url);
 static char *add_part_to_url(const char *url, const char *part);
+static char *fixup_location(const char *location);
+static bool write_catalog(const slapt_vector_t *sbs, const char *catalog_file, bool with_index);
+static void write_slackbuilds_to_file(const slapt_vector_t *sbs, const char *datafile);
+static slapt_src_catalog *read_catalog(const char *catalog_file);
 
 slapt_src_config *slapt_src_config_init(void)
 {
@@ -47,6 +133,16 @@ slapt_src_config *slapt_src_config_init(void)
     config->postcmd = NULL;
     config->do_dep = false;
     config->prompt = true;
+    config->jobs = 1;
+    config->prefetch = SLAPT_SRC_PREFETCH_DEFAULT;
+    config->prefetch_size = SLAPT_SRC_PREFETCH_SIZE_DEFAULT;
+    config->source_cache = NULL;
+    config->source_cache_size = SLAPT_SRC_SOURCE_CACHE_SIZE_DEFAULT;
+    config->pkg_cache = NULL;
+    config->ccache_dir = NULL;
+    config->make_jobs = 0;
+    config->adaptive = false;
+    config->tmpfs = NULL;
     return config;
 }
 
@@ -61,9 +157,48 @@ void slapt_src_config_free(slapt_src_config *config)
         free(config->pkgtag);
     if (config->postcmd != NULL)
         free(config->postcmd);
+    if (config->source_cache != NULL)
+        free(config->source_cache);
+    if (config->pkg_cache != NULL)
+        free(config->pkg_cache);
+    if (config->ccache_dir != NULL)
+        free(config->ccache_dir);
+    if (config->tmpfs != NULL)
+        free(config->tmpfs);
     free(config);
 }
 
+/* a byte count with an optional K, M or G suffix, 64 bit even where size_t is not */
+static bool parse_size(const char *value, uint64_t *size)
+{
+    char *end = NULL;
+    errno = 0;
+    const unsigned long long n = strtoull(value, &end, 10);
+    if (end == value || errno == ERANGE || value[0] == '-')
+        return false;
+
+    uint64_t multiplier = 1;
+    switch (toupper((unsigned char)*end)) {
+    case 'G':
+        multiplier *= 1024;
+        /* fall through */
+    case 'M':
+        multiplier *= 1024;
+        /* fall through */
+    case 'K':
+        multiplier *= 1024;
+        end++;
+        break;
+    default:
+        break;
+    }
+
+    if (*end != '\0' || n > UINT64_MAX / multiplier)
+        return false;
+    *size = (uint64_t)n * multiplier;
+    return true;
+}
+
 slapt_src_config *slapt_src_read_config(const char *filename)
 {
     FILE *rc = slapt_open_file(filename, "r");
@@ -105,6 +240,78 @@ slapt_src_config *slapt_src_read_config(const char *filename)
         } else if ((token_ptr = strstr(buffer, SLAPT_SRC_PKGTAG_TOKEN)) != NULL) {
             if (strlen(token_ptr) > strlen(SLAPT_SRC_PKGTAG_TOKEN))
                 config->pkgtag = strdup(token_ptr + strlen(SLAPT_SRC_PKGTAG_TOKEN));
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_PREFETCH_TOKEN)) != NULL) {
+            const char *value = token_ptr + strlen(SLAPT_SRC_PREFETCH_TOKEN);
+            char *end = NULL;
+            const unsigned long prefetch = strtoul(value, &end, 10);
+            if (end == value || *end != '\0' || prefetch > UINT32_MAX) {
+                fprintf(stderr, gettext("Invalid %s value: %s\n"), SLAPT_SRC_PREFETCH_TOKEN, value);
+                exit(EXIT_FAILURE);
+            }
+            config->prefetch = (uint32_t)prefetch;
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_PREFETCHSIZE_TOKEN)) != NULL) {
+            const char *value = token_ptr + strlen(SLAPT_SRC_PREFETCHSIZE_TOKEN);
+            uint64_t prefetch_size = 0;
+            if (!parse_size(value, &prefetch_size) || prefetch_size > SIZE_MAX) {
+                fprintf(stderr, gettext("Invalid %s value: %s\n"), SLAPT_SRC_PREFETCHSIZE_TOKEN, value);
+                exit(EXIT_FAILURE);
+            }
+            config->prefetch_size = (size_t)prefetch_size;
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_SOURCECACHE_TOKEN)) != NULL) {
+            if (strlen(token_ptr) > strlen(SLAPT_SRC_SOURCECACHE_TOKEN)) {
+                if (config->source_cache != NULL)
+                    free(config->source_cache);
+                config->source_cache = strdup(token_ptr + strlen(SLAPT_SRC_SOURCECACHE_TOKEN));
+            }
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_SOURCECACHESIZE_TOKEN)) != NULL) {
+            const char *value = token_ptr + strlen(SLAPT_SRC_SOURCECACHESIZE_TOKEN);
+            if (!parse_size(value, &config->source_cache_size)) {
+                fprintf(stderr, gettext("Invalid %s value: %s\n"), SLAPT_SRC_SOURCECACHESIZE_TOKEN, value);
+                exit(EXIT_FAILURE);
+            }
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_PKGCACHE_TOKEN)) != NULL) {
+            if (strlen(token_ptr) > strlen(SLAPT_SRC_PKGCACHE_TOKEN)) {
+                if (config->pkg_cache != NULL)
+                    free(config->pkg_cache);
+                config->pkg_cache = strdup(token_ptr + strlen(SLAPT_SRC_PKGCACHE_TOKEN));
+            }
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_CCACHE_TOKEN)) != NULL) {
+            if (strlen(token_ptr) > strlen(SLAPT_SRC_CCACHE_TOKEN)) {
+                if (config->ccache_dir != NULL)
+                    free(config->ccache_dir);
+                config->ccache_dir = strdup(token_ptr + strlen(SLAPT_SRC_CCACHE_TOKEN));
+            }
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_MAKEJOBS_TOKEN)) != NULL) {
+            const char *value = token_ptr + strlen(SLAPT_SRC_MAKEJOBS_TOKEN);
+            char *end = NULL;
+            const unsigned long make_jobs = strtoul(value, &end, 10);
+            if (end == value || *end != '\0' || make_jobs > SLAPT_SRC_MAKEJOBS_MAX) {
+                fprintf(stderr, gettext("Invalid %s value: %s\n"), SLAPT_SRC_MAKEJOBS_TOKEN, value);
+                exit(EXIT_FAILURE);
+            }
+            config->make_jobs = (uint32_t)make_jobs;
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_ADAPTIVE_TOKEN)) != NULL) {
+            const char *value = token_ptr + strlen(SLAPT_SRC_ADAPTIVE_TOKEN);
+            if (strcmp(value, "1") != 0 && strcmp(value, "0") != 0) {
+                fprintf(stderr, gettext("Invalid %s value: %s\n"), SLAPT_SRC_ADAPTIVE_TOKEN, value);
+                exit(EXIT_FAILURE);
+            }
+            config->adaptive = strcmp(value, "1") == 0;
+
+        } else if ((token_ptr = strstr(buffer, SLAPT_SRC_TMPFS_TOKEN)) != NULL) {
+            if (strlen(token_ptr) > strlen(SLAPT_SRC_TMPFS_TOKEN)) {
+                if (config->tmpfs != NULL)
+                    free(config->tmpfs);
+                config->tmpfs = strdup(token_ptr + strlen(SLAPT_SRC_TMPFS_TOKEN));
+            }
         }
     }
 
@@ -133,6 +340,8 @@ slapt_src_slackbuild *slapt_src_slackbuild_init(void)
     sb->download_x86_64 = NULL;
     sb->md5sum = NULL;
     sb->md5sum_x86_64 = NULL;
+    sb->sha256sum = NULL;
+    sb->sha256sum_x86_64 = NULL;
     sb->requires = NULL;
     sb->files = slapt_vector_t_init(free);
 
@@ -157,6 +366,10 @@ void slapt_src_slackbuild_free(slapt_src_slackbuild *sb)
         free(sb->md5sum);
     if (sb->md5sum_x86_64 != NULL)
         free(sb->md5sum_x86_64);
+    if (sb->sha256sum != NULL)
+        free(sb->sha256sum);
+    if (sb->sha256sum_x86_64 != NULL)
+        free(sb->sha256sum_x86_64);
     if (sb->short_desc != NULL)
         free(sb->short_desc);
     if (sb->requires != NULL)
@@ -167,86 +380,178 @@ void slapt_src_slackbuild_free(slapt_src_slackbuild *sb)
     free(sb);
 }
 
-bool slapt_src_update_slackbuild_cache(const slapt_src_config *config)
-{
-    bool rval = true;
-    slapt_config_t *slapt_config = slapt_config_t_init();
-    slapt_vector_t *slackbuilds = slapt_vector_t_init((slapt_vector_t_free_function)slapt_src_slackbuild_free);
+/* most records fit many to a chunk, oversized allocations get a chunk of their own */
+#define SLAPT_SRC_ARENA_CHUNK (256 * 1024)
+#define SLAPT_SRC_ARENA_ALIGN (sizeof(void *))
 
-    slapt_vector_t_foreach(const char *, url, config->sources) {
-        slapt_vector_t *sbs = NULL;
-        const char *files[] = {SLAPT_SRC_SOURCES_LIST_GZ, SLAPT_SRC_SOURCES_LIST, NULL};
+struct _slapt_src_arena_chunk_ {
+    slapt_src_arena_chunk *next;
+    size_t used;
+    size_t size;
+    alignas(max_align_t) char data[];
+};
 
-        printf(gettext("Fetching slackbuild list from %s..."), url);
+struct _slapt_src_arena_string_ {
+    const char *value;
+    uint32_t len;
+    uint32_t hash;
+};
 
-        for (int fc = 0; files[fc] != NULL; fc++) {
-            const char *err = NULL;
+slapt_src_arena *slapt_src_arena_init(void)
+{
+    slapt_src_arena *arena = slapt_malloc(sizeof *arena);
+    arena->chunks = NULL;
+    arena->strings = NULL;
+    arena->strings_count = 0;
+    arena->strings_capacity = 0;
+    arena->chunk_count = 0;
+    arena->bytes = 0;
+    arena->interned = 0;
+    arena->interned_hits = 0;
+    return arena;
+}
 
-            char *filename = slapt_gen_filename_from_url(url, files[fc]);
-            char *local_head = slapt_read_head_cache(filename);
-            char *head = slapt_head_mirror_data(url, files[fc]);
+void slapt_src_arena_free(slapt_src_arena *arena)
+{
+    slapt_src_arena_chunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        slapt_src_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    if (arena->strings != NULL)
+        free(arena->strings);
+    free(arena);
+}
 
-            /* is it cached ? */
-            if (head != NULL && local_head != NULL && strcmp(head, local_head) == 0) {
-                printf(gettext("Cached\n"));
-                sbs = slapt_src_get_slackbuilds_from_file(filename);
-            } else {
-                FILE *f = slapt_open_file(filename, "w+b");
-                if (f == NULL) {
-                    exit(EXIT_FAILURE);
-                }
+static void *arena_alloc(slapt_src_arena *arena, size_t size, size_t align)
+{
+    slapt_src_arena_chunk *chunk = arena->chunks;
+    if (chunk != NULL) {
+        const size_t offset = (chunk->used + align - 1) & ~(align - 1);
+        if (offset + size <= chunk->size) {
+            chunk->used = offset + size;
+            arena->bytes += size;
+            return chunk->data + offset;
+        }
+    }
 
-                err = slapt_get_mirror_data_from_source(f, slapt_config, url, files[fc]);
-                fclose(f);
+    const size_t chunk_size = size > SLAPT_SRC_ARENA_CHUNK / 4 ? size : SLAPT_SRC_ARENA_CHUNK;
+    chunk = slapt_malloc(sizeof *chunk + chunk_size);
+    chunk->size = chunk_size;
+    chunk->used = size;
+    arena->chunk_count++;
+    arena->bytes += size;
+
+    /* keep filling the current chunk if this one was only for a large allocation */
+    if (chunk_size == size && arena->chunks != NULL) {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    } else {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
 
-                if (!err) {
-                    printf(gettext("Done\n"));
-                    sbs = slapt_src_get_slackbuilds_from_file(filename);
+    return chunk->data;
+}
 
-                    if (head != NULL)
-                        slapt_write_head_cache(head, filename);
+void *slapt_src_arena_alloc(slapt_src_arena *arena, size_t size)
+{
+    return arena_alloc(arena, size, SLAPT_SRC_ARENA_ALIGN);
+}
 
-                    free(head);
-                    free(local_head);
-                    free(filename);
-                    break;
+char *slapt_src_arena_strndup(slapt_src_arena *arena, const char *s, size_t len)
+{
+    char *copy = arena_alloc(arena, len + 1, 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
 
-                } else {
-                    slapt_clear_head_cache(filename);
-                }
-            }
-            if (strcmp(files[fc], SLAPT_SRC_SOURCES_LIST_GZ) != 0) {
-                if (err) {
-                    fprintf(stderr, gettext("Download failed: %s\n"), err);
-                } else {
-                    fprintf(stderr, gettext("Download failed: %s\n"), "404");
-                }
-                rval = false;
-            }
+/* FNV-1a */
+static uint32_t hash_string(const char *s, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-            free(filename);
-            free(local_head);
-            free(head);
+static void arena_grow_strings(slapt_src_arena *arena)
+{
+    const uint32_t capacity = arena->strings_capacity ? arena->strings_capacity * 2 : 1024;
+    slapt_src_arena_string *strings = slapt_malloc(sizeof *strings * capacity);
+    for (uint32_t i = 0; i < capacity; i++)
+        strings[i].value = NULL;
+
+    for (uint32_t i = 0; i < arena->strings_capacity; i++) {
+        const slapt_src_arena_string *string = &arena->strings[i];
+        if (string->value == NULL)
+            continue;
+        uint32_t slot = string->hash & (capacity - 1);
+        while (strings[slot].value != NULL)
+            slot = (slot + 1) & (capacity - 1);
+        strings[slot] = *string;
+    }
 
-            if (sbs != NULL)
-                break;
-        }
+    if (arena->strings != NULL)
+        free(arena->strings);
+    arena->strings = strings;
+    arena->strings_capacity = capacity;
+}
 
-        if (sbs != NULL) {
-            slapt_vector_t_foreach(slapt_src_slackbuild *, sb, sbs) {
-                if (sb->sb_source_url == NULL)
-                    sb->sb_source_url = strdup(url);
-                slapt_vector_t_add(slackbuilds, sb);
-            }
-            sbs->free_function = NULL; /* don't free the slackbuilds here */
-            slapt_vector_t_free(sbs);
+/* returns a shared copy of s, equal values return the same pointer */
+char *slapt_src_arena_intern(slapt_src_arena *arena, const char *s, size_t len)
+{
+    if (len >= UINT32_MAX)
+        return slapt_src_arena_strndup(arena, s, len);
+
+    if ((arena->strings_count + 1) * 4 > arena->strings_capacity * 3)
+        arena_grow_strings(arena);
+
+    const uint32_t hash = hash_string(s, len);
+    uint32_t slot = hash & (arena->strings_capacity - 1);
+    while (arena->strings[slot].value != NULL) {
+        const slapt_src_arena_string *string = &arena->strings[slot];
+        if (string->hash == hash && string->len == len && memcmp(string->value, s, len) == 0) {
+            arena->interned_hits++;
+            return (char *)string->value;
         }
+        slot = (slot + 1) & (arena->strings_capacity - 1);
     }
 
-    slapt_src_write_slackbuilds_to_file(slackbuilds, SLAPT_SRC_DATA_FILE);
-    slapt_config_t_free(slapt_config);
-    slapt_vector_t_free(slackbuilds);
-    return rval;
+    char *copy = slapt_src_arena_strndup(arena, s, len);
+    arena->strings[slot].value = copy;
+    arena->strings[slot].len = (uint32_t)len;
+    arena->strings[slot].hash = hash;
+    arena->strings_count++;
+    arena->interned++;
+    return copy;
+}
+
+slapt_src_slackbuild *slapt_src_arena_slackbuild_init(slapt_src_arena *arena)
+{
+    slapt_src_slackbuild *sb = slapt_src_arena_alloc(arena, sizeof *sb);
+    sb->name = NULL;
+    sb->version = NULL;
+    sb->location = NULL;
+    sb->sb_source_url = NULL;
+    sb->short_desc = NULL;
+    sb->download = NULL;
+    sb->download_x86_64 = NULL;
+    sb->md5sum = NULL;
+    sb->md5sum_x86_64 = NULL;
+    sb->sha256sum = NULL;
+    sb->sha256sum_x86_64 = NULL;
+    sb->requires = NULL;
+
+    /* never grown after parsing, so it lives in the arena too */
+    sb->files = slapt_src_arena_alloc(arena, sizeof *sb->files);
+    *sb->files = (slapt_vector_t){.size = 0, .capacity = 0, .items = NULL, .free_function = NULL, .sorted = false};
+
+    return sb;
 }
 
 static int sb_cmp(const void *a, const void *b)
@@ -261,11 +566,285 @@ static int sb_cmp(const void *a, const void *b)
         return slapt_pkg_t_cmp_versions(sb1->version, sb2->version);
 }
 
-void slapt_src_write_slackbuilds_to_file(slapt_vector_t *sbs, const char *datafile)
+/* parse a downloaded source list and keep a sorted binary shard of it next to the raw file */
+static slapt_src_catalog *parse_source(const char *filename, const char *url, const char *shard_file)
 {
-    FILE *f = slapt_open_file(datafile, "w+b");
+    slapt_src_catalog *catalog = slapt_src_catalog_init();
+    catalog->arena = slapt_src_arena_init();
+    catalog->slackbuilds = slapt_src_get_slackbuilds_from_file(filename, catalog->arena);
+
+    char *source_url = slapt_src_arena_intern(catalog->arena, url, strlen(url));
+    slapt_vector_t_foreach(slapt_src_slackbuild *, sb, catalog->slackbuilds) {
+        if (sb->sb_source_url == NULL)
+            sb->sb_source_url = source_url;
+    }
+    slapt_vector_t_sort(catalog->slackbuilds, sb_cmp);
+
+    if (write_catalog(catalog->slackbuilds, shard_file, false)) {
+        slapt_src_catalog *shard = read_catalog(shard_file);
+        if (shard != NULL) {
+            slapt_src_catalog_free(catalog);
+            catalog = shard;
+        }
+    } else {
+        unlink(shard_file);
+    }
+
+    return catalog;
+}
+
+/* reuse the shard of an unchanged source, as long as it is not older than the raw file */
+static slapt_src_catalog *read_source_shard(const char *filename, const char *shard_file)
+{
+    struct stat file_stat, shard_stat;
+    if (stat(shard_file, &shard_stat) != 0 || stat(filename, &file_stat) != 0 || shard_stat.st_mtime < file_stat.st_mtime)
+        return NULL;
+    return read_catalog(shard_file);
+}
+
+/* k-way merge of the sorted per source shards, ties keep source order */
+static slapt_vector_t *merge_sources(const slapt_vector_t *sources)
+{
+    slapt_vector_t *merged = slapt_vector_t_init(NULL);
+    uint32_t *positions = calloc(sources->size + 1, sizeof *positions);
+    if (positions == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        const slapt_src_slackbuild *next = NULL;
+        uint32_t next_source = 0;
+        for (uint32_t i = 0; i < sources->size; i++) {
+            const slapt_src_catalog *source = sources->items[i];
+            if (positions[i] >= source->slackbuilds->size)
+                continue;
+            const slapt_src_slackbuild *candidate = source->slackbuilds->items[positions[i]];
+            if (next == NULL || sb_cmp(&candidate, &next) < 0) {
+                next = candidate;
+                next_source = i;
+            }
+        }
+        if (next == NULL)
+            break;
+        slapt_vector_t_add(merged, (void *)next);
+        positions[next_source]++;
+    }
+
+    free(positions);
+    merged->sorted = true;
+    return merged;
+}
+
+/* the shards the merged catalog was last built from, one per line */
+static char *sources_manifest(const slapt_vector_t *shard_files)
+{
+    size_t len = 1;
+    slapt_vector_t_foreach(const char *, shard_file, shard_files) {
+        len += strlen(shard_file) + 1;
+    }
+
+    char *manifest = slapt_malloc(sizeof *manifest * len);
+    manifest[0] = '\0';
+    slapt_vector_t_foreach(const char *, shard_file, shard_files) {
+        strcat(manifest, shard_file);
+        strcat(manifest, "\n");
+    }
+    return manifest;
+}
+
+/* true if the merged catalog was built from exactly these shards and is newer than all of them */
+static bool merged_catalog_current(const slapt_vector_t *shard_files, const char *manifest)
+{
+    struct stat catalog_stat, data_stat;
+    if (stat(SLAPT_SRC_CATALOG_FILE, &catalog_stat) != 0 || stat(SLAPT_SRC_DATA_FILE, &data_stat) != 0)
+        return false;
+
+    slapt_vector_t_foreach(const char *, shard_file, shard_files) {
+        struct stat shard_stat;
+        if (stat(shard_file, &shard_stat) != 0 || shard_stat.st_mtime > catalog_stat.st_mtime)
+            return false;
+    }
+
+    FILE *f = fopen(SLAPT_SRC_SOURCES_FILE, "r");
+    if (f == NULL)
+        return false;
+
+    const size_t len = strlen(manifest);
+    char *previous = slapt_malloc(sizeof *previous * (len + 2));
+    const size_t read = fread(previous, 1, len + 1, f);
+    fclose(f);
+
+    const bool current = read == len && memcmp(previous, manifest, len) == 0;
+    free(previous);
+    return current;
+}
+
+/* per source state while its list is fetched, tries each of source_files in turn */
+typedef struct _slapt_src_source_fetch_ {
+    const char *url;
+    uint32_t file;
+    char *filename;
+    char *shard_file;
+    char *local_head;
+    char *head;
+    slapt_src_catalog *catalog;
+    bool parsed;
+    bool failed;
+} slapt_src_source_fetch;
+
+static const char *source_files[] = {SLAPT_SRC_SOURCES_LIST_GZ, SLAPT_SRC_SOURCES_LIST, NULL};
+
+static void source_head_done(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer);
+static void source_data_done(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer);
+
+static void source_fetch_free_file(slapt_src_source_fetch *fetch)
+{
+    if (fetch->filename != NULL)
+        free(fetch->filename);
+    if (fetch->shard_file != NULL)
+        free(fetch->shard_file);
+    if (fetch->local_head != NULL)
+        free(fetch->local_head);
+    if (fetch->head != NULL)
+        free(fetch->head);
+    fetch->filename = fetch->shard_file = fetch->local_head = fetch->head = NULL;
+}
+
+static void source_fetch_start(slapt_src_transfer_pool *pool, slapt_src_source_fetch *fetch)
+{
+    const char *file = source_files[fetch->file];
+    fetch->filename = slapt_gen_filename_from_url(fetch->url, file);
+    fetch->shard_file = add_part_to_url(fetch->filename, SLAPT_SRC_CATALOG_EXT);
+    fetch->local_head = slapt_read_head_cache(fetch->filename);
+
+    char *url = add_part_to_url(fetch->url, file);
+    slapt_src_transfer_pool_add(pool, slapt_src_transfer_init(url, NULL, source_head_done, fetch));
+    free(url);
+}
+
+static void source_head_done(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer)
+{
+    slapt_src_source_fetch *fetch = transfer->data;
+    fetch->head = transfer->head;
+    transfer->head = NULL;
+
+    /* is it cached ? */
+    if (fetch->head != NULL && fetch->local_head != NULL && strcmp(fetch->head, fetch->local_head) == 0) {
+        printf(gettext("Fetching slackbuild list from %s..."), fetch->url);
+        printf(gettext("Cached\n"));
+        fetch->catalog = read_source_shard(fetch->filename, fetch->shard_file);
+        if (fetch->catalog == NULL) {
+            fetch->catalog = parse_source(fetch->filename, fetch->url, fetch->shard_file);
+            fetch->parsed = true;
+        }
+        return;
+    }
+
+    unlink(fetch->shard_file);
+
+    char *url = add_part_to_url(fetch->url, source_files[fetch->file]);
+    slapt_src_transfer_pool_add(pool, slapt_src_transfer_init(url, fetch->filename, source_data_done, fetch));
+    free(url);
+}
+
+static void source_data_done(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer)
+{
+    slapt_src_source_fetch *fetch = transfer->data;
+
+    if (transfer->ok) {
+        printf(gettext("Fetching slackbuild list from %s..."), fetch->url);
+        printf(gettext("Done\n"));
+        /* parse now, while the other sources are still downloading */
+        fetch->catalog = parse_source(fetch->filename, fetch->url, fetch->shard_file);
+        fetch->parsed = true;
+        if (fetch->head != NULL)
+            slapt_write_head_cache(fetch->head, fetch->filename);
+        return;
+    }
+
+    slapt_clear_head_cache(fetch->filename);
+    if (source_files[fetch->file + 1] != NULL) {
+        source_fetch_free_file(fetch);
+        fetch->file++;
+        source_fetch_start(pool, fetch);
+        return;
+    }
+
+    printf(gettext("Fetching slackbuild list from %s..."), fetch->url);
+    fprintf(stderr, gettext("Download failed: %s\n"), transfer->error);
+    fetch->failed = true;
+}
+
+bool slapt_src_update_slackbuild_cache(const slapt_src_config *config)
+{
+    bool rval = true, parsed = false;
+    slapt_vector_t *sources = slapt_vector_t_init((slapt_vector_t_free_function)slapt_src_catalog_free);
+    slapt_vector_t *shard_files = slapt_vector_t_init(free);
+
+    /* fetch every source at once, each is parsed as soon as its download completes */
+    slapt_src_source_fetch *fetches = calloc(config->sources->size + 1, sizeof *fetches);
+    if (fetches == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+
+    slapt_src_transfer_pool *pool = slapt_src_transfer_pool_init(SLAPT_SRC_MAX_TRANSFERS, SLAPT_SRC_MAX_HOST_TRANSFERS);
+    for (uint32_t i = 0; i < config->sources->size; i++) {
+        fetches[i].url = config->sources->items[i];
+        source_fetch_start(pool, &fetches[i]);
+    }
+    slapt_src_transfer_pool_run(pool);
+    slapt_src_transfer_pool_free(pool);
+
+    /* merge in configured source order, regardless of which finished first */
+    for (uint32_t i = 0; i < config->sources->size; i++) {
+        slapt_src_source_fetch *fetch = &fetches[i];
+        if (fetch->catalog != NULL) {
+            slapt_vector_t_add(sources, fetch->catalog);
+            slapt_vector_t_add(shard_files, fetch->shard_file);
+            fetch->shard_file = NULL;
+        }
+        if (fetch->failed)
+            rval = false;
+        if (fetch->parsed)
+            parsed = true;
+        source_fetch_free_file(fetch);
+    }
+    free(fetches);
+
+    /* nothing to do if every source came from the shards the catalog was built from */
+    char *manifest = sources_manifest(shard_files);
+    if (parsed || !merged_catalog_current(shard_files, manifest)) {
+        slapt_vector_t *slackbuilds = merge_sources(sources);
+        write_slackbuilds_to_file(slackbuilds, SLAPT_SRC_DATA_FILE);
+        slapt_vector_t_free(slackbuilds);
+
+        FILE *f = fopen(SLAPT_SRC_SOURCES_FILE, "w");
+        if (f != NULL) {
+            fputs(manifest, f);
+            fclose(f);
+        }
+    }
 
+    free(manifest);
+    slapt_vector_t_free(shard_files);
+    slapt_vector_t_free(sources);
+    return rval;
+}
+
+void slapt_src_write_slackbuilds_to_file(slapt_vector_t *sbs, const char *datafile)
+{
     slapt_vector_t_sort(sbs, sb_cmp);
+    write_slackbuilds_to_file(sbs, datafile);
+}
+
+/* sbs must already be sorted */
+static void write_slackbuilds_to_file(const slapt_vector_t *sbs, const char *datafile)
+{
+    FILE *f = slapt_open_file(datafile, "w+b");
+    if (f == NULL)
+        exit(EXIT_FAILURE);
 
     slapt_vector_t_foreach(const slapt_src_slackbuild *, sb, sbs) {
         /* write out package data */
@@ -273,24 +852,9 @@ void slapt_src_write_slackbuilds_to_file(slapt_vector_t *sbs, const char *datafi
         fprintf(f, "SLACKBUILD SOURCEURL: %s\n", sb->sb_source_url);
 
         /* fixup locations so they are easier to work with later */
-        {
-            char *location = strdup(sb->location);
-
-            if (location[strlen(location) - 1] != '/') {
-                char *fixed = add_part_to_url(location, "/");
-                free(location);
-                location = fixed;
-            }
-
-            if (strncmp(location, "./", 2) == 0) {
-                char *fixed = strdup(location + 2);
-                free(location);
-                location = fixed;
-            }
-
-            fprintf(f, "SLACKBUILD LOCATION: %s\n", location);
-            free(location);
-        }
+        char *location = fixup_location(sb->location);
+        fprintf(f, "SLACKBUILD LOCATION: %s\n", location);
+        free(location);
 
         fprintf(f, "SLACKBUILD FILES: ");
         for (uint32_t c = 0; c < sb->files->size; c++) {
@@ -305,334 +869,2153 @@ void slapt_src_write_slackbuilds_to_file(slapt_vector_t *sbs, const char *datafi
         fprintf(f, "SLACKBUILD DOWNLOAD_x86_64: %s\n", sb->download_x86_64 ? sb->download_x86_64 : "");
         fprintf(f, "SLACKBUILD MD5SUM: %s\n", sb->md5sum ? sb->md5sum : "");
         fprintf(f, "SLACKBUILD MD5SUM_x86_64: %s\n", sb->md5sum_x86_64 ? sb->md5sum_x86_64 : "");
+        /* only some sources publish these, leave them out rather than write empty lines */
+        if (sb->sha256sum != NULL)
+            fprintf(f, "SLACKBUILD SHA256SUM: %s\n", sb->sha256sum);
+        if (sb->sha256sum_x86_64 != NULL)
+            fprintf(f, "SLACKBUILD SHA256SUM_x86_64: %s\n", sb->sha256sum_x86_64);
         fprintf(f, "SLACKBUILD REQUIRES: %s\n", sb->requires ? sb->requires : "");
         fprintf(f, "SLACKBUILD SHORT DESCRIPTION: %s\n", sb->short_desc ? sb->short_desc : "");
         fprintf(f, "\n");
     }
 
     fclose(f);
+
+    /* the binary catalog is only an accelerator, the text data remains authoritative */
+    char *catalog_file = add_part_to_url(datafile, SLAPT_SRC_CATALOG_EXT);
+    if (!write_catalog(sbs, catalog_file, true))
+        fprintf(stderr, gettext("Failed to write %s\n"), catalog_file);
+    free(catalog_file);
 }
 
-slapt_vector_t *slapt_src_get_slackbuilds_from_file(const char *datafile)
+static uint32_t catalog_add_string(slapt_src_catalog_strings *strings, const char *s)
 {
-    slapt_vector_t *sbs = slapt_vector_t_init((slapt_vector_t_free_function)slapt_src_slackbuild_free);
-    enum { SLAPT_SRC_NOT_PARSING,
-           SLAPT_SRC_PARSING } parse_state;
-    parse_state = SLAPT_SRC_NOT_PARSING;
-
-    /* support reading from gzip'd files */
-    FILE *f = NULL;
-    if (strstr(datafile, ".gz") != NULL) {
-        gzFile data = NULL;
-        char gzbuffer[SLAPT_MAX_ZLIB_BUFFER];
+    if (s == NULL)
+        return SLAPT_SRC_CATALOG_NULL;
 
-        if ((f = tmpfile()) == NULL)
-            exit(EXIT_FAILURE);
+    const size_t len = strlen(s) + 1;
+    if (len > (size_t)(SLAPT_SRC_CATALOG_NULL - strings->size)) {
+        fprintf(stderr, gettext("Catalog string table is too large\n"));
+        exit(EXIT_FAILURE);
+    }
 
-        if ((data = gzopen(datafile, "rb")) == NULL)
+    if (strings->size + len > strings->capacity) {
+        size_t capacity = strings->capacity ? strings->capacity : 4096;
+        while (capacity < strings->size + len)
+            capacity *= 2;
+        if (capacity > SLAPT_SRC_CATALOG_NULL)
+            capacity = SLAPT_SRC_CATALOG_NULL;
+        char *data = realloc(strings->data, capacity);
+        if (data == NULL) {
+            fprintf(stderr, gettext("Failed to allocate memory\n"));
             exit(EXIT_FAILURE);
-
-        while (gzgets(data, gzbuffer, SLAPT_MAX_ZLIB_BUFFER) != Z_NULL) {
-            fprintf(f, "%s", gzbuffer);
-        }
-        gzclose(data);
-        rewind(f);
-
-    } else {
-        f = fopen(datafile, "r");
-        if (f == NULL) {
-            printf(gettext("Failed to open %s for reading\n"), datafile);
-            return sbs;
         }
+        strings->data = data;
+        strings->capacity = (uint32_t)capacity;
     }
 
-    slapt_src_slackbuild *sb = NULL;
-    char *buffer = NULL;
-    size_t gb_length = 0;
-    ssize_t g_size;
-    while ((g_size = getline(&buffer, &gb_length, f)) != EOF) {
-        char *token = NULL;
+    const uint32_t offset = strings->size;
+    memcpy(strings->data + offset, s, len);
+    strings->size += (uint32_t)len;
+    return offset;
+}
 
-        if (strstr(buffer, "SLACKBUILD NAME:") != NULL) {
-            parse_state = SLAPT_SRC_PARSING;
-            sb = slapt_src_slackbuild_init();
-        }
+/* REQUIRES is comma separated, or space separated in older data */
+static slapt_vector_t *split_requires(const char *requires)
+{
+    if (strstr(requires, ",") != NULL)
+        return slapt_parse_delimited_list(requires, ',');
+    return slapt_parse_delimited_list(requires, ' ');
+}
 
-        if ((strcmp(buffer, "\n") == 0) && (parse_state == SLAPT_SRC_PARSING)) {
-            slapt_vector_t_add(sbs, sb);
-            /* do not free, in use in sbs list
-            slapt_src_slackbuild_free (sb);
-            */
-            sb = NULL;
-            parse_state = SLAPT_SRC_NOT_PARSING;
-        }
+/* position of the first record named name in the sorted sbs, SLAPT_SRC_CATALOG_NULL if there is none */
+static uint32_t catalog_first_record(const slapt_vector_t *sbs, const char *name)
+{
+    uint32_t lo = 0, hi = sbs->size;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const slapt_src_slackbuild *sb = sbs->items[mid];
+        if (strcmp(sb->name, name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < sbs->size && strcmp(((const slapt_src_slackbuild *)sbs->items[lo])->name, name) == 0)
+        return lo;
+    return SLAPT_SRC_CATALOG_NULL;
+}
 
-        switch (parse_state) {
-        case SLAPT_SRC_PARSING:
+/*
+ * split the REQUIRES of each of the sorted sbs into edges to the first record
+ * of every required name.  An edge to a record reuses its name_offsets entry,
+ * only names without a record, or all of them without name_offsets, are added
+ * to strings.
+ */
+static slapt_src_catalog_edge *catalog_build_edges(
+    const slapt_vector_t *sbs,
+    const uint32_t *name_offsets,
+    slapt_src_catalog_strings *strings,
+    slapt_src_catalog_requires *requires,
+    uint32_t *edge_count)
+{
+    slapt_src_catalog_edge *edges = NULL;
+    uint32_t count = 0, capacity = 0;
+
+    for (uint32_t i = 0; i < sbs->size; i++) {
+        const slapt_src_slackbuild *sb = sbs->items[i];
+        requires[i].first = count;
+        requires[i].count = 0;
+        requires[i].has_readme = false;
+        if (sb->requires == NULL)
+            continue;
 
-            /* we skip empty fields for odd sscanf bug in older glibcs */
-            if (strstr(buffer, ": \n") != NULL)
+        slapt_vector_t *dep_names = split_requires(sb->requires);
+        slapt_vector_t_foreach(const char *, dep_name, dep_names) {
+            /* skip non-deps */
+            if (strcmp(dep_name, "%README%") == 0) {
+                requires[i].has_readme = true;
                 continue;
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD NAME: %ms", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->name = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD SOURCEURL: %ms", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->sb_source_url = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD LOCATION: %ms", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->location = strdup(token);
-                free(token);
             }
 
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD FILES: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                slapt_vector_t *files = slapt_parse_delimited_list(token, ' ');
-                slapt_vector_t_foreach(const char *, file, files) {
-                    slapt_vector_t_add(sb->files, strdup(file));
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                edges = realloc(edges, sizeof *edges * capacity);
+                if (edges == NULL) {
+                    fprintf(stderr, gettext("Failed to allocate memory\n"));
+                    exit(EXIT_FAILURE);
                 }
-                slapt_vector_t_free(files);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD VERSION: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->version = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD DOWNLOAD: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->download = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD DOWNLOAD_x86_64: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->download_x86_64 = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD MD5SUM: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->md5sum = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD MD5SUM_x86_64: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->md5sum_x86_64 = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD REQUIRES: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->requires = strdup(token);
-                free(token);
-            }
-
-            #pragma GCC diagnostic push
-            #pragma GCC diagnostic ignored "-Wformat"
-            if ((sscanf(buffer, "SLACKBUILD SHORT DESCRIPTION: %m[^\n]", &token)) == 1) {
-            #pragma GCC diagnostic pop
-                sb->short_desc = strdup(token);
-                free(token);
             }
 
-            break;
-
-        default:
-            break;
+            const uint32_t target = catalog_first_record(sbs, dep_name);
+            edges[count].target = target;
+            if (target != SLAPT_SRC_CATALOG_NULL && name_offsets != NULL)
+                edges[count].name = name_offsets[target];
+            else
+                edges[count].name = catalog_add_string(strings, dep_name);
+            count++;
+            requires[i].count++;
         }
+        slapt_vector_t_free(dep_names);
     }
 
-    if (buffer != NULL)
-        free(buffer);
-
-    fclose(f);
-
-    sbs->sorted = true;
-    return sbs;
+    *edge_count = count;
+    return edges;
 }
 
-slapt_vector_t *slapt_src_get_available_slackbuilds(void)
+static void u32_array_add(slapt_src_u32_array *array, uint32_t value)
 {
-    return slapt_src_get_slackbuilds_from_file(SLAPT_SRC_DATA_FILE);
+    if (array->size == array->capacity) {
+        array->capacity = array->capacity ? array->capacity * 2 : 256;
+        array->items = realloc(array->items, sizeof *array->items * array->capacity);
+        if (array->items == NULL) {
+            fprintf(stderr, gettext("Failed to allocate memory\n"));
+            exit(EXIT_FAILURE);
+        }
+    }
+    array->items[array->size++] = value;
 }
 
-static char *filename_from_url(char *url)
+/* trigrams are ascii case folded, so the index serves case sensitive and insensitive searches alike */
+static uint32_t trigram_key(const char *s)
 {
-    char *filename = NULL;
-    slapt_vector_t *parts = slapt_parse_delimited_list(url, '/');
-    if (parts->size > 0) {
-        filename = strdup(parts->items[parts->size - 1]);
+    uint32_t key = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 'A' && c <= 'Z')
+            c = (unsigned char)(c - 'A' + 'a');
+        key = (key << 8) | c;
     }
-    slapt_vector_t_free(parts);
-
-    return filename;
+    return key;
 }
 
-static char *add_part_to_url(const char *url, const char *part)
+static void add_trigrams(slapt_src_u32_array *trigrams, const char *s, size_t len)
 {
-    char *new = malloc(sizeof *new *(strlen(url) + strlen(part) + 1));
-    if (new != NULL) {
-        new = strcpy(new, url);
-        new = strcat(new, part);
-    }
+    for (size_t i = 0; i + 3 <= len; i++)
+        u32_array_add(trigrams, trigram_key(s + i));
+}
 
-    return new;
+static int u32_cmp(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
 }
 
-bool slapt_src_fetch_slackbuild(const slapt_src_config *config, const slapt_src_slackbuild *sb)
+static int u64_cmp(const void *a, const void *b)
 {
-    bool rv = true;
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * index the searched fields of every record, the string offsets of records
+ * are into strings.  false if the postings would not fit the catalog.
+ */
+static bool catalog_build_index_table(
+    const slapt_src_catalog_record *records,
+    uint32_t record_count,
+    const slapt_src_catalog_strings *strings,
+    slapt_src_u32_array *table,
+    slapt_src_u32_array *postings)
+{
+    slapt_src_u32_array trigrams = {.items = NULL, .size = 0, .capacity = 0};
+    uint64_t *pairs = NULL;
+    size_t pair_count = 0, pair_capacity = 0;
+
+    for (uint32_t i = 0; i < record_count; i++) {
+        const uint32_t fields[] = {records[i].name, records[i].location, records[i].short_desc};
+        trigrams.size = 0;
+        for (uint32_t f = 0; f < sizeof fields / sizeof fields[0]; f++) {
+            if (fields[f] == SLAPT_SRC_CATALOG_NULL)
+                continue;
+            const char *field = strings->data + fields[f];
+            add_trigrams(&trigrams, field, strlen(field));
+        }
+        if (trigrams.size == 0)
+            continue;
+
+        qsort(trigrams.items, trigrams.size, sizeof *trigrams.items, u32_cmp);
+        for (uint32_t t = 0; t < trigrams.size; t++) {
+            if (t > 0 && trigrams.items[t] == trigrams.items[t - 1])
+                continue;
+            if (pair_count == pair_capacity) {
+                pair_capacity = pair_capacity ? pair_capacity * 2 : 4096;
+                pairs = realloc(pairs, sizeof *pairs * pair_capacity);
+                if (pairs == NULL) {
+                    fprintf(stderr, gettext("Failed to allocate memory\n"));
+                    exit(EXIT_FAILURE);
+                }
+            }
+            pairs[pair_count++] = ((uint64_t)trigrams.items[t] << 32) | i;
+        }
+    }
+
+    if (trigrams.items != NULL)
+        free(trigrams.items);
+    if (pair_count >= SLAPT_SRC_CATALOG_NULL) {
+        free(pairs);
+        return false;
+    }
+
+    /* records were visited in order, so each trigram's postings come out ascending */
+    if (pair_count > 0)
+        qsort(pairs, pair_count, sizeof *pairs, u64_cmp);
+    for (size_t p = 0; p < pair_count; p++) {
+        const uint32_t trigram = (uint32_t)(pairs[p] >> 32);
+        if (p == 0 || trigram != (uint32_t)(pairs[p - 1] >> 32)) {
+            u32_array_add(table, trigram);
+            u32_array_add(table, postings->size);
+            u32_array_add(table, 0);
+        }
+        table->items[table->size - 1]++;
+        u32_array_add(postings, (uint32_t)pairs[p]);
+    }
+
+    if (pairs != NULL)
+        free(pairs);
+    return true;
+}
+
+static bool write_catalog(const slapt_vector_t *sbs, const char *catalog_file, bool with_index)
+{
+    slapt_src_catalog_header header = {
+        .version = SLAPT_SRC_CATALOG_VERSION,
+        .flags = 0,
+        .record_count = sbs->size,
+        .file_count = 0,
+        .edge_count = 0,
+        .trigram_count = 0,
+        .posting_count = 0,
+        .strings_size = 0,
+    };
+    memcpy(header.magic, SLAPT_SRC_CATALOG_MAGIC, sizeof header.magic);
+
+    slapt_src_catalog_record *records = slapt_malloc(sizeof *records * (sbs->size + 1));
+    slapt_src_catalog_strings strings = {.data = NULL, .size = 0, .capacity = 0};
+
+    for (uint32_t i = 0; i < sbs->size; i++) {
+        const slapt_src_slackbuild *sb = sbs->items[i];
+        slapt_src_catalog_record *record = &records[i];
+
+        char *location = fixup_location(sb->location);
+        record->name = catalog_add_string(&strings, sb->name);
+        record->version = catalog_add_string(&strings, sb->version);
+        record->location = catalog_add_string(&strings, location);
+        record->sb_source_url = catalog_add_string(&strings, sb->sb_source_url);
+        record->download = catalog_add_string(&strings, sb->download);
+        record->download_x86_64 = catalog_add_string(&strings, sb->download_x86_64);
+        record->md5sum = catalog_add_string(&strings, sb->md5sum);
+        record->md5sum_x86_64 = catalog_add_string(&strings, sb->md5sum_x86_64);
+        record->sha256sum = catalog_add_string(&strings, sb->sha256sum);
+        record->sha256sum_x86_64 = catalog_add_string(&strings, sb->sha256sum_x86_64);
+        record->short_desc = catalog_add_string(&strings, sb->short_desc);
+        record->requires = catalog_add_string(&strings, sb->requires);
+        free(location);
+
+        record->files = SLAPT_SRC_CATALOG_NULL;
+        record->files_count = sb->files->size;
+        slapt_vector_t_foreach(const char *, file, sb->files) {
+            const uint32_t offset = catalog_add_string(&strings, file);
+            if (record->files == SLAPT_SRC_CATALOG_NULL)
+                record->files = offset;
+        }
+        header.file_count += sb->files->size;
+    }
+
+    /* resolved against the records being written, the sbs are already sorted */
+    uint32_t *name_offsets = slapt_malloc(sizeof *name_offsets * (sbs->size + 1));
+    slapt_src_catalog_requires *requires = slapt_malloc(sizeof *requires * (sbs->size + 1));
+    for (uint32_t i = 0; i < sbs->size; i++)
+        name_offsets[i] = records[i].name;
+    slapt_src_catalog_edge *edges = catalog_build_edges(sbs, name_offsets, &strings, requires, &header.edge_count);
+    for (uint32_t i = 0; i < sbs->size; i++) {
+        records[i].edges = requires[i].first;
+        records[i].edges_count = requires[i].count;
+        records[i].flags = requires[i].has_readme ? SLAPT_SRC_CATALOG_HAS_README : 0;
+    }
+    free(name_offsets);
+    free(requires);
+
+    /* table holds trigram, first posting and posting count triples, laid out like slapt_src_catalog_trigram */
+    slapt_src_u32_array table = {.items = NULL, .size = 0, .capacity = 0};
+    slapt_src_u32_array postings = {.items = NULL, .size = 0, .capacity = 0};
+    if (with_index && catalog_build_index_table(records, sbs->size, &strings, &table, &postings)) {
+        header.flags |= SLAPT_SRC_CATALOG_HAS_INDEX;
+        header.trigram_count = table.size / 3;
+        header.posting_count = postings.size;
+    }
+    header.strings_size = strings.size;
+
+    /* write to a temporary file and rename so readers never see a partial catalog */
+    char *tmp_file = add_part_to_url(catalog_file, ".tmp");
+    bool written = false;
+    FILE *f = fopen(tmp_file, "wb");
+    if (f != NULL) {
+        written = fwrite(&header, sizeof header, 1, f) == 1 &&
+                  fwrite(records, sizeof *records, sbs->size, f) == sbs->size &&
+                  (header.edge_count == 0 || fwrite(edges, sizeof *edges, header.edge_count, f) == header.edge_count) &&
+                  (table.size == 0 || fwrite(table.items, sizeof *table.items, table.size, f) == table.size) &&
+                  (postings.size == 0 || fwrite(postings.items, sizeof *postings.items, postings.size, f) == postings.size) &&
+                  fwrite(strings.data, 1, strings.size, f) == strings.size;
+        if (fclose(f) != 0)
+            written = false;
+        if (written && rename(tmp_file, catalog_file) != 0)
+            written = false;
+        if (!written)
+            unlink(tmp_file);
+    }
+
+    free(tmp_file);
+    free(records);
+    if (edges != NULL)
+        free(edges);
+    if (table.items != NULL)
+        free(table.items);
+    if (postings.items != NULL)
+        free(postings.items);
+    free(strings.data);
+    return written;
+}
+
+/* resolve a string table offset, returns false if it points outside the table */
+static bool catalog_string(const char *strings, uint32_t strings_size, uint32_t offset, char **s)
+{
+    if (offset == SLAPT_SRC_CATALOG_NULL) {
+        *s = NULL;
+        return true;
+    }
+    if (offset >= strings_size)
+        return false;
+    *s = (char *)strings + offset;
+    return true;
+}
+
+static slapt_src_catalog *read_catalog(const char *catalog_file)
+{
+    const int fd = open(catalog_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(slapt_src_catalog_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    const size_t map_len = (size_t)st.st_size;
+    void *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    const slapt_src_catalog_header *header = map;
+    const size_t records_len = sizeof(slapt_src_catalog_record) * header->record_count;
+    const size_t edges_len = sizeof(slapt_src_catalog_edge) * header->edge_count;
+    const size_t index_len = sizeof(slapt_src_catalog_trigram) * header->trigram_count + sizeof(uint32_t) * header->posting_count;
+    if (memcmp(header->magic, SLAPT_SRC_CATALOG_MAGIC, sizeof header->magic) != 0 ||
+        header->version != SLAPT_SRC_CATALOG_VERSION ||
+        map_len != sizeof *header + records_len + edges_len + index_len + header->strings_size ||
+        (header->strings_size > 0 && ((const char *)map)[map_len - 1] != '\0')) {
+        munmap(map, map_len);
+        return NULL;
+    }
+
+    const slapt_src_catalog_record *records = (const void *)((const char *)map + sizeof *header);
+    const slapt_src_catalog_edge *edges = (const void *)((const char *)map + sizeof *header + records_len);
+    const slapt_src_catalog_trigram *trigrams = (const void *)((const char *)map + sizeof *header + records_len + edges_len);
+    const uint32_t *postings = (const uint32_t *)(trigrams + header->trigram_count);
+    const char *strings = (const char *)map + sizeof *header + records_len + edges_len + index_len;
+
+    slapt_src_catalog *catalog = slapt_src_catalog_init();
+    catalog->map = map;
+    catalog->map_len = map_len;
+    /* the edges are used in place, only checked that they stay inside the catalog */
+    for (uint32_t e = 0; e < header->edge_count; e++) {
+        if ((edges[e].target != SLAPT_SRC_CATALOG_NULL && edges[e].target >= header->record_count) ||
+            edges[e].name >= header->strings_size) {
+            slapt_src_catalog_free(catalog);
+            return NULL;
+        }
+    }
+    catalog->edges = edges;
+    catalog->edge_names = strings;
+    /* postings are bounds checked as searches use them, loading stays independent of the index size */
+    if (header->flags & SLAPT_SRC_CATALOG_HAS_INDEX) {
+        catalog->index.trigrams = trigrams;
+        catalog->index.trigram_count = header->trigram_count;
+        catalog->index.postings = postings;
+        catalog->index.posting_count = header->posting_count;
+    }
+    catalog->requires = slapt_malloc(sizeof *catalog->requires * (header->record_count + 1));
+    catalog->records = slapt_malloc(sizeof *catalog->records * (header->record_count + 1));
+    catalog->record_files = slapt_malloc(sizeof *catalog->record_files * (header->record_count + 1));
+    catalog->file_names = slapt_malloc(sizeof *catalog->file_names * (header->file_count + 1));
+
+    /* the records and their file lists point straight into the mapping */
+    catalog->slackbuilds = slapt_vector_t_init(NULL);
+    catalog->slackbuilds->items = slapt_malloc(sizeof *catalog->slackbuilds->items * (header->record_count + 1));
+    catalog->slackbuilds->capacity = header->record_count;
+
+    uint32_t file_index = 0;
+    for (uint32_t i = 0; i < header->record_count; i++) {
+        const slapt_src_catalog_record *record = &records[i];
+        slapt_src_slackbuild *sb = &catalog->records[i];
+
+        const bool valid =
+            catalog_string(strings, header->strings_size, record->name, &sb->name) && sb->name != NULL &&
+            catalog_string(strings, header->strings_size, record->version, &sb->version) && sb->version != NULL &&
+            catalog_string(strings, header->strings_size, record->location, &sb->location) && sb->location != NULL &&
+            catalog_string(strings, header->strings_size, record->sb_source_url, &sb->sb_source_url) &&
+            catalog_string(strings, header->strings_size, record->download, &sb->download) &&
+            catalog_string(strings, header->strings_size, record->download_x86_64, &sb->download_x86_64) &&
+            catalog_string(strings, header->strings_size, record->md5sum, &sb->md5sum) &&
+            catalog_string(strings, header->strings_size, record->md5sum_x86_64, &sb->md5sum_x86_64) &&
+            catalog_string(strings, header->strings_size, record->sha256sum, &sb->sha256sum) &&
+            catalog_string(strings, header->strings_size, record->sha256sum_x86_64, &sb->sha256sum_x86_64) &&
+            catalog_string(strings, header->strings_size, record->short_desc, &sb->short_desc) &&
+            catalog_string(strings, header->strings_size, record->requires, &sb->requires) &&
+            record->files_count <= header->file_count - file_index &&
+            record->edges <= header->edge_count && record->edges_count <= header->edge_count - record->edges;
+        if (!valid) {
+            slapt_src_catalog_free(catalog);
+            return NULL;
+        }
+
+        slapt_vector_t *files = &catalog->record_files[i];
+        files->size = record->files_count;
+        files->capacity = record->files_count;
+        files->items = (void **)&catalog->file_names[file_index];
+        files->free_function = NULL;
+        files->sorted = false;
+
+        uint32_t offset = record->files;
+        for (uint32_t c = 0; c < record->files_count; c++) {
+            char *file = NULL;
+            if (!catalog_string(strings, header->strings_size, offset, &file) || file == NULL) {
+                slapt_src_catalog_free(catalog);
+                return NULL;
+            }
+            catalog->file_names[file_index++] = file;
+            offset += (uint32_t)strlen(file) + 1;
+        }
+        sb->files = files;
+
+        catalog->requires[i].first = record->edges;
+        catalog->requires[i].count = record->edges_count;
+        catalog->requires[i].has_readme = (record->flags & SLAPT_SRC_CATALOG_HAS_README) != 0;
+
+        catalog->slackbuilds->items[i] = sb;
+        catalog->slackbuilds->size = i + 1;
+    }
+
+    catalog->slackbuilds->sorted = true;
+    return catalog;
+}
+
+typedef enum {
+    SLAPT_SRC_FIELD_UNKNOWN,
+    SLAPT_SRC_FIELD_NAME,
+    SLAPT_SRC_FIELD_SOURCEURL,
+    SLAPT_SRC_FIELD_LOCATION,
+    SLAPT_SRC_FIELD_FILES,
+    SLAPT_SRC_FIELD_VERSION,
+    SLAPT_SRC_FIELD_DOWNLOAD,
+    SLAPT_SRC_FIELD_DOWNLOAD_X86_64,
+    SLAPT_SRC_FIELD_MD5SUM,
+    SLAPT_SRC_FIELD_MD5SUM_X86_64,
+    SLAPT_SRC_FIELD_SHA256SUM,
+    SLAPT_SRC_FIELD_SHA256SUM_X86_64,
+    SLAPT_SRC_FIELD_REQUIRES,
+    SLAPT_SRC_FIELD_SHORT_DESC,
+} slapt_src_field;
+
+#define SLAPT_SRC_FIELD_PREFIX "SLACKBUILD "
+#define SLAPT_SRC_FIELD_PREFIX_LEN (sizeof(SLAPT_SRC_FIELD_PREFIX) - 1)
+
+/* field names are unique by length and their first two characters, so one switch finds the candidate */
+static slapt_src_field parse_field_name(const char *key, size_t len)
+{
+    slapt_src_field field = SLAPT_SRC_FIELD_UNKNOWN;
+    const char *expected = NULL;
+
+    switch (len) {
+    case 4:
+        field = SLAPT_SRC_FIELD_NAME;
+        expected = "NAME";
+        break;
+    case 5:
+        field = SLAPT_SRC_FIELD_FILES;
+        expected = "FILES";
+        break;
+    case 6:
+        field = SLAPT_SRC_FIELD_MD5SUM;
+        expected = "MD5SUM";
+        break;
+    case 7:
+        field = SLAPT_SRC_FIELD_VERSION;
+        expected = "VERSION";
+        break;
+    case 8:
+        switch (key[0]) {
+        case 'L':
+            field = SLAPT_SRC_FIELD_LOCATION;
+            expected = "LOCATION";
+            break;
+        case 'D':
+            field = SLAPT_SRC_FIELD_DOWNLOAD;
+            expected = "DOWNLOAD";
+            break;
+        case 'R':
+            field = SLAPT_SRC_FIELD_REQUIRES;
+            expected = "REQUIRES";
+            break;
+        default:
+            break;
+        }
+        break;
+    case 9:
+        if (key[1] == 'O') {
+            field = SLAPT_SRC_FIELD_SOURCEURL;
+            expected = "SOURCEURL";
+        } else {
+            field = SLAPT_SRC_FIELD_SHA256SUM;
+            expected = "SHA256SUM";
+        }
+        break;
+    case 13:
+        field = SLAPT_SRC_FIELD_MD5SUM_X86_64;
+        expected = "MD5SUM_x86_64";
+        break;
+    case 15:
+        field = SLAPT_SRC_FIELD_DOWNLOAD_X86_64;
+        expected = "DOWNLOAD_x86_64";
+        break;
+    case 16:
+        field = SLAPT_SRC_FIELD_SHA256SUM_X86_64;
+        expected = "SHA256SUM_x86_64";
+        break;
+    case 17:
+        field = SLAPT_SRC_FIELD_SHORT_DESC;
+        expected = "SHORT DESCRIPTION";
+        break;
+    default:
+        break;
+    }
+
+    if (expected == NULL || memcmp(key, expected, len) != 0)
+        return SLAPT_SRC_FIELD_UNKNOWN;
+    return field;
+}
+
+/* parse a single "SLACKBUILD KEY: value" line into sb, the line is not modified */
+static void parse_slackbuild_line(slapt_src_arena *arena, slapt_src_slackbuild *sb, slapt_src_field field, const char *value, size_t len)
+{
+    /* single word fields stop at the first whitespace */
+    if (field == SLAPT_SRC_FIELD_NAME || field == SLAPT_SRC_FIELD_SOURCEURL || field == SLAPT_SRC_FIELD_LOCATION) {
+        size_t word_len = 0;
+        while (word_len < len && !isspace((unsigned char)value[word_len]))
+            word_len++;
+        len = word_len;
+    }
+
+    /* values repeated across many slackbuilds are interned, the rest copied */
+    switch (field) {
+    case SLAPT_SRC_FIELD_NAME:
+        sb->name = slapt_src_arena_strndup(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_SOURCEURL:
+        sb->sb_source_url = slapt_src_arena_intern(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_LOCATION:
+        sb->location = slapt_src_arena_strndup(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_FILES: {
+        const char *end = value + len;
+        uint32_t count = 0;
+        for (const char *file = value; file < end; file++) {
+            if (*file != ' ' && (file == value || file[-1] == ' '))
+                count++;
+        }
+
+        char **items = slapt_src_arena_alloc(arena, sizeof *items * count);
+        uint32_t c = 0;
+        const char *file = value;
+        while (file < end) {
+            const char *space = memchr(file, ' ', (size_t)(end - file));
+            const char *file_end = space != NULL ? space : end;
+            if (file_end > file)
+                items[c++] = slapt_src_arena_intern(arena, file, (size_t)(file_end - file));
+            file = file_end + 1;
+        }
+
+        sb->files->items = (void **)items;
+        sb->files->size = count;
+        sb->files->capacity = count;
+    } break;
+    case SLAPT_SRC_FIELD_VERSION:
+        sb->version = slapt_src_arena_intern(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_DOWNLOAD:
+        sb->download = slapt_src_arena_strndup(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_DOWNLOAD_X86_64:
+        sb->download_x86_64 = slapt_src_arena_intern(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_MD5SUM:
+        sb->md5sum = slapt_src_arena_strndup(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_MD5SUM_X86_64:
+        sb->md5sum_x86_64 = slapt_src_arena_intern(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_SHA256SUM:
+        sb->sha256sum = slapt_src_arena_strndup(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_SHA256SUM_X86_64:
+        sb->sha256sum_x86_64 = slapt_src_arena_intern(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_REQUIRES:
+        sb->requires = slapt_src_arena_intern(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_SHORT_DESC:
+        sb->short_desc = slapt_src_arena_strndup(arena, value, len);
+        break;
+    case SLAPT_SRC_FIELD_UNKNOWN:
+    default:
+        break;
+    }
+}
+
+static void add_parsed_slackbuild(slapt_vector_t *sbs, slapt_src_slackbuild *sb)
+{
+    /* everything downstream relies on these, incomplete records are left in the arena */
+    if (sb->name == NULL || sb->version == NULL || sb->location == NULL)
+        return;
+    slapt_vector_t_add(sbs, sb);
+}
+
+/* buffered line reader over gzFile, which also reads uncompressed files transparently */
+#define SLAPT_SRC_READER_BUFFER (64 * 1024)
+
+typedef struct _slapt_src_line_reader_ {
+    gzFile data;
+    char *buffer;
+    size_t size;
+    size_t start;
+    size_t capacity;
+    bool eof;
+} slapt_src_line_reader;
+
+static bool line_reader_open(slapt_src_line_reader *reader, const char *filename)
+{
+    if ((reader->data = gzopen(filename, "rb")) == NULL)
+        return false;
+    gzbuffer(reader->data, 2 * SLAPT_SRC_READER_BUFFER);
+
+    reader->buffer = slapt_malloc(SLAPT_SRC_READER_BUFFER);
+    reader->size = 0;
+    reader->start = 0;
+    reader->capacity = SLAPT_SRC_READER_BUFFER;
+    reader->eof = false;
+    return true;
+}
+
+static void line_reader_close(slapt_src_line_reader *reader)
+{
+    gzclose(reader->data);
+    free(reader->buffer);
+}
+
+/* returns the next line, without the newline, pointing into the reader buffer; valid until the next call */
+static const char *line_reader_next(slapt_src_line_reader *reader, size_t *len)
+{
+    for (;;) {
+        char *line = reader->buffer + reader->start;
+        const size_t avail = reader->size - reader->start;
+
+        char *newline = memchr(line, '\n', avail);
+        if (newline != NULL) {
+            *len = (size_t)(newline - line);
+            reader->start += *len + 1;
+            return line;
+        }
+
+        if (reader->eof) {
+            if (avail == 0)
+                return NULL;
+            *len = avail;
+            reader->start = reader->size;
+            return line;
+        }
+
+        /* keep the partial line, growing the buffer only for lines longer than it */
+        memmove(reader->buffer, line, avail);
+        reader->size = avail;
+        reader->start = 0;
+        if (reader->size == reader->capacity) {
+            reader->capacity *= 2;
+            char *buffer = realloc(reader->buffer, reader->capacity);
+            if (buffer == NULL) {
+                fprintf(stderr, gettext("Failed to allocate memory\n"));
+                exit(EXIT_FAILURE);
+            }
+            reader->buffer = buffer;
+        }
+
+        const int read = gzread(reader->data, reader->buffer + reader->size, (unsigned int)(reader->capacity - reader->size));
+        if (read < 0) {
+            int errnum = 0;
+            fprintf(stderr, gettext("Failed to read data: %s\n"), gzerror(reader->data, &errnum));
+            reader->eof = true;
+        } else if (read == 0) {
+            reader->eof = true;
+        } else {
+            reader->size += (size_t)read;
+        }
+    }
+}
+
+/* the returned slackbuilds are owned by arena */
+slapt_vector_t *slapt_src_get_slackbuilds_from_file(const char *datafile, slapt_src_arena *arena)
+{
+    slapt_vector_t *sbs = slapt_vector_t_init(NULL);
+
+    /* gzip'd files are inflated as they are parsed */
+    slapt_src_line_reader reader;
+    if (!line_reader_open(&reader, datafile)) {
+        printf(gettext("Failed to open %s for reading\n"), datafile);
+        return sbs;
+    }
+
+    slapt_src_slackbuild *sb = NULL;
+    const char *line = NULL;
+    size_t line_len = 0;
+    while ((line = line_reader_next(&reader, &line_len)) != NULL) {
+        if (line_len > 0 && line[line_len - 1] == '\r')
+            line_len--;
+
+        /* a blank line ends the current slackbuild */
+        if (line_len == 0) {
+            if (sb != NULL) {
+                add_parsed_slackbuild(sbs, sb);
+                sb = NULL;
+            }
+            continue;
+        }
+
+        if (line_len <= SLAPT_SRC_FIELD_PREFIX_LEN || memcmp(line, SLAPT_SRC_FIELD_PREFIX, SLAPT_SRC_FIELD_PREFIX_LEN) != 0)
+            continue;
+
+        const char *key = line + SLAPT_SRC_FIELD_PREFIX_LEN;
+        const char *colon = memchr(key, ':', line_len - SLAPT_SRC_FIELD_PREFIX_LEN);
+        if (colon == NULL)
+            continue;
+
+        const slapt_src_field field = parse_field_name(key, (size_t)(colon - key));
+        if (field == SLAPT_SRC_FIELD_UNKNOWN)
+            continue;
+
+        if (field == SLAPT_SRC_FIELD_NAME) {
+            if (sb != NULL)
+                add_parsed_slackbuild(sbs, sb);
+            sb = slapt_src_arena_slackbuild_init(arena);
+        } else if (sb == NULL) {
+            continue;
+        }
+
+        /* skip the separator, empty fields are left unset */
+        const char *value = colon + 1;
+        const char *end = line + line_len;
+        while (value < end && isspace((unsigned char)*value))
+            value++;
+        if (value == end)
+            continue;
+
+        parse_slackbuild_line(arena, sb, field, value, (size_t)(end - value));
+    }
+
+    if (sb != NULL)
+        add_parsed_slackbuild(sbs, sb);
+
+    line_reader_close(&reader);
+
+    sbs->sorted = true;
+    return sbs;
+}
+
+struct _slapt_src_name_index_entry_ {
+    const char *name;
+    uint32_t hash;
+    uint32_t first;
+    uint32_t count;
+};
+
+static void name_index_init(slapt_src_name_index *index, uint32_t size)
+{
+    uint32_t capacity = 16;
+    while (capacity < size * 2)
+        capacity *= 2;
+
+    index->entries = slapt_malloc(sizeof *index->entries * capacity);
+    for (uint32_t i = 0; i < capacity; i++)
+        index->entries[i].name = NULL;
+    index->capacity = capacity;
+    index->count = 0;
+}
+
+static void name_index_free(slapt_src_name_index *index)
+{
+    if (index->entries != NULL)
+        free(index->entries);
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+static slapt_src_name_index_entry *name_index_slot(const slapt_src_name_index *index, const char *name, uint32_t hash)
+{
+    uint32_t slot = hash & (index->capacity - 1);
+    while (index->entries[slot].name != NULL) {
+        slapt_src_name_index_entry *entry = &index->entries[slot];
+        if (entry->hash == hash && strcmp(entry->name, name) == 0)
+            return entry;
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    return &index->entries[slot];
+}
+
+/* positions of the same name are expected to be added consecutively */
+static void name_index_add(slapt_src_name_index *index, const char *name, uint32_t position)
+{
+    const uint32_t hash = hash_string(name, strlen(name));
+    slapt_src_name_index_entry *entry = name_index_slot(index, name, hash);
+    if (entry->name != NULL) {
+        entry->count++;
+        return;
+    }
+
+    entry->name = name;
+    entry->hash = hash;
+    entry->first = position;
+    entry->count = 1;
+    index->count++;
+}
+
+static const slapt_src_name_index_entry *name_index_find(const slapt_src_name_index *index, const char *name)
+{
+    if (index->capacity == 0)
+        return NULL;
+    const slapt_src_name_index_entry *entry = name_index_slot(index, name, hash_string(name, strlen(name)));
+    return entry->name != NULL ? entry : NULL;
+}
+
+static void catalog_build_index(slapt_src_catalog *catalog)
+{
+    name_index_init(&catalog->names, catalog->slackbuilds->size);
+    for (uint32_t i = 0; i < catalog->slackbuilds->size; i++) {
+        const slapt_src_slackbuild *sb = catalog->slackbuilds->items[i];
+        name_index_add(&catalog->names, sb->name, i);
+    }
+}
+
+/* returns the position of the first (oldest) record for name, count is 0 if there are none */
+uint32_t slapt_src_catalog_find(const slapt_src_catalog *catalog, const char *name, uint32_t *count)
+{
+    const slapt_src_name_index_entry *entry = name_index_find(&catalog->names, name);
+    if (entry == NULL) {
+        *count = 0;
+        return 0;
+    }
+    *count = entry->count;
+    return entry->first;
+}
+
+uint32_t slapt_src_catalog_position(const slapt_src_catalog *catalog, const slapt_src_slackbuild *sb)
+{
+    uint32_t count = 0;
+    const uint32_t first = slapt_src_catalog_find(catalog, sb->name, &count);
+    for (uint32_t i = first; i < first + count; i++) {
+        if (catalog->slackbuilds->items[i] == sb)
+            return i;
+    }
+    return UINT32_MAX;
+}
+
+/* the text data only has REQUIRES as written, resolve it the same way write_catalog does */
+static void catalog_build_requires(slapt_src_catalog *catalog)
+{
+    const slapt_vector_t *sbs = catalog->slackbuilds;
+    slapt_src_catalog_strings strings = {.data = NULL, .size = 0, .capacity = 0};
+    uint32_t edge_count = 0;
+
+    catalog->requires = slapt_malloc(sizeof *catalog->requires * (sbs->size + 1));
+    slapt_src_catalog_edge *edges = catalog_build_edges(sbs, NULL, &strings, catalog->requires, &edge_count);
+
+    /* copied into the arena so they go away with the records they belong to */
+    if (edge_count > 0) {
+        slapt_src_catalog_edge *arena_edges = slapt_src_arena_alloc(catalog->arena, sizeof *edges * edge_count);
+        memcpy(arena_edges, edges, sizeof *edges * edge_count);
+        catalog->edges = arena_edges;
+        catalog->edge_names = slapt_src_arena_strndup(catalog->arena, strings.data, strings.size);
+    }
+
+    if (edges != NULL)
+        free(edges);
+    if (strings.data != NULL)
+        free(strings.data);
+}
+
+slapt_src_catalog *slapt_src_catalog_init(void)
+{
+    slapt_src_catalog *catalog = slapt_malloc(sizeof *catalog);
+    catalog->slackbuilds = NULL;
+    catalog->map = NULL;
+    catalog->map_len = 0;
+    catalog->records = NULL;
+    catalog->record_files = NULL;
+    catalog->file_names = NULL;
+    catalog->arena = NULL;
+    catalog->requires = NULL;
+    catalog->edges = NULL;
+    catalog->edge_names = NULL;
+    catalog->index.trigrams = NULL;
+    catalog->index.trigram_count = 0;
+    catalog->index.postings = NULL;
+    catalog->index.posting_count = 0;
+    catalog->names.entries = NULL;
+    catalog->names.capacity = 0;
+    catalog->names.count = 0;
+    return catalog;
+}
+
+void slapt_src_catalog_free(slapt_src_catalog *catalog)
+{
+    if (catalog->slackbuilds != NULL)
+        slapt_vector_t_free(catalog->slackbuilds);
+    if (catalog->records != NULL)
+        free(catalog->records);
+    if (catalog->record_files != NULL)
+        free(catalog->record_files);
+    if (catalog->file_names != NULL)
+        free(catalog->file_names);
+    if (catalog->requires != NULL)
+        free(catalog->requires);
+    if (catalog->map != NULL)
+        munmap(catalog->map, catalog->map_len);
+    if (catalog->arena != NULL)
+        slapt_src_arena_free(catalog->arena);
+    name_index_free(&catalog->names);
+    free(catalog);
+}
+
+slapt_src_catalog *slapt_src_get_available_slackbuilds(void)
+{
+    slapt_src_catalog *catalog = NULL;
+
+    /* prefer the binary catalog unless the text data was rewritten after it */
+    struct stat data_stat, catalog_stat;
+    if (stat(SLAPT_SRC_CATALOG_FILE, &catalog_stat) == 0) {
+        if (stat(SLAPT_SRC_DATA_FILE, &data_stat) != 0 || data_stat.st_mtime <= catalog_stat.st_mtime)
+            catalog = read_catalog(SLAPT_SRC_CATALOG_FILE);
+    }
+
+    if (catalog == NULL) {
+        catalog = slapt_src_catalog_init();
+        catalog->arena = slapt_src_arena_init();
+        catalog->slackbuilds = slapt_src_get_slackbuilds_from_file(SLAPT_SRC_DATA_FILE, catalog->arena);
+        catalog_build_requires(catalog);
+    }
+
+    catalog_build_index(catalog);
+    return catalog;
+}
+
+static char *filename_from_url(char *url)
+{
+    char *filename = NULL;
+    slapt_vector_t *parts = slapt_parse_delimited_list(url, '/');
+    if (parts->size > 0) {
+        filename = strdup(parts->items[parts->size - 1]);
+    }
+    slapt_vector_t_free(parts);
+
+    return filename;
+}
+
+static char *add_part_to_url(const char *url, const char *part)
+{
+    char *new = malloc(sizeof *new *(strlen(url) + strlen(part) + 1));
+    if (new != NULL) {
+        new = strcpy(new, url);
+        new = strcat(new, part);
+    }
+
+    return new;
+}
+
+/* trailing slash, no leading ./ */
+static char *fixup_location(const char *location)
+{
+    char *fixed = strdup(location);
+
+    if (fixed[strlen(fixed) - 1] != '/') {
+        char *slashed = add_part_to_url(fixed, "/");
+        free(fixed);
+        fixed = slashed;
+    }
+
+    if (strncmp(fixed, "./", 2) == 0) {
+        char *stripped = strdup(fixed + 2);
+        free(fixed);
+        fixed = stripped;
+    }
+
+    return fixed;
+}
+
+/* DOWNLOAD_x86_64 replaces DOWNLOAD on x86_64, unless it is empty or a placeholder */
+static bool uses_x86_64_download(const slapt_src_slackbuild *sb)
+{
+    return strcmp(uname_v.machine, "x86_64") == 0 && sb->download_x86_64 != NULL && strcmp(sb->download_x86_64, "") != 0 && strcmp(sb->download_x86_64, "UNSUPPORTED") != 0 && strcmp(sb->download_x86_64, "UNTESTED") != 0;
+}
+
+/* progress of fetching everything one slackbuild needs */
+typedef struct _slapt_src_fetch_state_ {
+    uint32_t index;
+    uint32_t pending;
+    bool failed;
+    uint64_t expected; /* what its downloads come to, as far as known */
+    uint32_t unsized;  /* downloads whose size is not known yet */
+    int report_fd;     /* where the prefetcher reports completion, -1 otherwise */
+} slapt_src_fetch_state;
+
+/* sent from the prefetcher as each slackbuild completes */
+typedef struct _slapt_src_prefetch_report_ {
+    uint32_t index;
+    uint32_t ok;
+} slapt_src_prefetch_report;
+
+#define SLAPT_SRC_SHA256_STR_LEN 64
+#define SLAPT_SRC_DIGEST_BUFFER (64 * 1024)
+
+/* checksums of a download, updated as its bytes are written */
+typedef struct _slapt_src_digest_ {
+    EVP_MD_CTX *md5;
+    EVP_MD_CTX *sha256; /* NULL without a sha256sum to check */
+    size_t bytes;
+} slapt_src_digest;
+
+/*
+ * the source store keeps every verified tarball once, named by its checksum,
+ * and places it in the build directory of each slackbuild needing it.
+ * downloads land in <key>.part, guarded by a lock on <key>.lock so
+ * concurrent slapt-src runs never write the same entry.
+ */
+#define SLAPT_SRC_STORE_PART_EXT ".part"
+#define SLAPT_SRC_STORE_LOCK_EXT ".lock"
+
+typedef struct _slapt_src_store_fetch_ slapt_src_store_fetch;
+
+typedef struct _slapt_src_source_store_ {
+    const char *dir; /* NULL without a SOURCECACHE */
+    uint64_t max_size;
+    slapt_vector_t *fetching; /* slapt_src_store_fetch started by this process */
+} slapt_src_source_store;
+
+/* a build directory file waiting on a store download */
+typedef struct _slapt_src_store_waiter_ {
+    char *filename;
+    slapt_src_fetch_state *state;
+} slapt_src_store_waiter;
+
+typedef struct _slapt_src_download_ slapt_src_download;
+
+/* one store entry being downloaded, shared by every slackbuild in the set needing it */
+struct _slapt_src_store_fetch_ {
+    char *key;
+    char *entry;
+    int lock_fd;                  /* -1 once the download is over */
+    slapt_src_download *download; /* the transfer in flight, NULL once the download is over */
+    slapt_vector_t *waiters;
+};
+
+/* one queued download of a slackbuild file or source tarball */
+struct _slapt_src_download_ {
+    char *name;
+    char *md5sum;    /* NULL for the slackbuild files themselves */
+    char *sha256sum; /* NULL unless the source publishes one */
+    slapt_src_digest *digest;
+    size_t seeded;                      /* bytes of an existing partial file already in digest */
+    slapt_src_fetch_state *state;       /* NULL when downloading into the store */
+    slapt_src_store_fetch *store_fetch; /* NULL when downloading into the build directory */
+    uint64_t counted;                   /* added to the expected size of each state it is for */
+    bool sized;
+};
+
+static EVP_MD_CTX *digest_ctx_init(const EVP_MD *type)
+{
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx == NULL || EVP_DigestInit_ex(ctx, type, NULL) != 1) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+    return ctx;
+}
+
+static slapt_src_digest *digest_init(bool sha256)
+{
+    slapt_src_digest *digest = slapt_malloc(sizeof *digest);
+    digest->md5 = digest_ctx_init(EVP_md5());
+    digest->sha256 = sha256 ? digest_ctx_init(EVP_sha256()) : NULL;
+    digest->bytes = 0;
+    return digest;
+}
+
+static void digest_free(slapt_src_digest *digest)
+{
+    EVP_MD_CTX_free(digest->md5);
+    if (digest->sha256 != NULL)
+        EVP_MD_CTX_free(digest->sha256);
+    free(digest);
+}
+
+static void digest_update(slapt_src_digest *digest, const void *data, size_t len)
+{
+    EVP_DigestUpdate(digest->md5, data, len);
+    if (digest->sha256 != NULL)
+        EVP_DigestUpdate(digest->sha256, data, len);
+    digest->bytes += len;
+}
+
+/* hash everything in f from the start, false on a read error */
+static bool digest_update_file(slapt_src_digest *digest, FILE *f)
+{
+    char *buffer = slapt_malloc(SLAPT_SRC_DIGEST_BUFFER);
+    size_t len = 0;
+    rewind(f);
+    while ((len = fread(buffer, 1, SLAPT_SRC_DIGEST_BUFFER, f)) > 0)
+        digest_update(digest, buffer, len);
+    const bool ok = !ferror(f);
+    free(buffer);
+    return ok;
+}
+
+/* hex of the digest so far, taken from a copy so digest can keep going */
+static void digest_ctx_hex(const EVP_MD_CTX *ctx, char *hex)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
+    EVP_MD_CTX *copy = EVP_MD_CTX_new();
+    if (copy == NULL || EVP_MD_CTX_copy_ex(copy, ctx) != 1 || EVP_DigestFinal_ex(copy, md, &md_len) != 1) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+    EVP_MD_CTX_free(copy);
+    for (unsigned int i = 0; i < md_len; i++)
+        sprintf(hex + i * 2, "%02x", md[i]);
+}
+
+/* the digests come out as lowercase hex, published sums are lowercased once to compare against them */
+static void sums_tolower(slapt_vector_t *sums)
+{
+    slapt_vector_t_foreach(char *, sum, sums) {
+        for (char *p = sum; *p != '\0'; p++)
+            *p = (char)tolower((unsigned char)*p);
+    }
+}
+
+/* check the digest against the lowercased published sums, filename is reported on a mismatch when given */
+static bool digest_verify(const slapt_src_digest *digest, const char *md5sum, const char *sha256sum, const char *filename)
+{
+    char md5sum_to_prove[SLAPT_MD5_STR_LEN + 1];
+    digest_ctx_hex(digest->md5, md5sum_to_prove);
+    if (strcmp(md5sum_to_prove, md5sum) != 0) {
+        if (filename != NULL)
+            printf(gettext("MD5SUM mismatch for %s\n"), filename);
+        return false;
+    }
+
+    if (digest->sha256 != NULL) {
+        char sha256sum_to_prove[SLAPT_SRC_SHA256_STR_LEN + 1];
+        digest_ctx_hex(digest->sha256, sha256sum_to_prove);
+        if (strcmp(sha256sum_to_prove, sha256sum) != 0) {
+            if (filename != NULL)
+                printf(gettext("SHA256SUM mismatch for %s\n"), filename);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void download_done(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer);
+
+static void fetch_state_report(const slapt_src_fetch_state *state)
+{
+    if (state->report_fd == -1)
+        return;
+
+    const slapt_src_prefetch_report report = {state->index, !state->failed};
+    if (write(state->report_fd, &report, sizeof report) != sizeof report)
+        _exit(EXIT_FAILURE);
+}
+
+/* add download to what state expects its downloads to come to, or take it back out */
+static void fetch_state_expect(slapt_src_fetch_state *state, const slapt_src_download *download, bool add)
+{
+    if (download->sized) {
+        if (add)
+            state->expected += download->counted;
+        else
+            state->expected -= download->counted;
+    } else {
+        if (add)
+            state->unsized++;
+        else
+            state->unsized--;
+    }
+}
+
+/* a store download counts for every slackbuild waiting on it */
+static void download_expect(const slapt_src_download *download, bool add)
+{
+    if (download->store_fetch == NULL) {
+        fetch_state_expect(download->state, download, add);
+        return;
+    }
+
+    slapt_vector_t_foreach (slapt_src_store_waiter *, waiter, download->store_fetch->waiters)
+        fetch_state_expect(waiter->state, download, add);
+}
+
+static void download_sized(slapt_src_download *download, uint64_t size)
+{
+    download_expect(download, false);
+    download->sized = true;
+    download->counted = size;
+    download_expect(download, true);
+}
+
+/* the response headers gave the size of the whole file */
+static void download_size(slapt_src_transfer *transfer, uint64_t size)
+{
+    slapt_src_download *download = transfer->data;
+    if (!download->sized)
+        download_sized(download, size);
+}
+
+static void download_write(slapt_src_transfer *transfer, const char *data, size_t len)
+{
+    slapt_src_download *download = transfer->data;
+    digest_update(download->digest, data, len);
+}
+
+static slapt_src_download *download_init(const char *name, const char *md5sum, const char *sha256sum, slapt_src_digest *seed, slapt_src_fetch_state *state)
+{
+    slapt_src_download *download = slapt_malloc(sizeof *download);
+    download->name = strdup(name);
+    download->md5sum = md5sum != NULL ? strdup(md5sum) : NULL;
+    download->sha256sum = sha256sum != NULL ? strdup(sha256sum) : NULL;
+    download->digest = seed;
+    if (download->digest == NULL && md5sum != NULL)
+        download->digest = digest_init(sha256sum != NULL);
+    download->seeded = seed != NULL ? seed->bytes : 0;
+    download->state = state;
+    download->store_fetch = NULL;
+    download->counted = 0;
+    download->sized = false;
+    return download;
+}
+
+/*
+ * checksummed downloads are hashed as they arrive.  When the digest was
+ * seeded from the partial filename already there, the transfer resumes after it.
+ */
+static void queue_download(slapt_src_transfer_pool *pool, const char *url, const char *filename, slapt_src_download *download)
+{
+    if (download->state != NULL)
+        download->state->pending++;
+    if (download->store_fetch != NULL)
+        download->store_fetch->download = download;
+    download_expect(download, true);
+
+    slapt_src_transfer *transfer = slapt_src_transfer_init(url, filename, download_done, download);
+    transfer->resume = download->seeded > 0;
+    transfer->size = download_size;
+    if (download->digest != NULL)
+        transfer->write = download_write;
+    slapt_src_transfer_pool_add(pool, transfer);
+}
+
+static void download_free(slapt_src_download *download)
+{
+    if (download->md5sum != NULL)
+        free(download->md5sum);
+    if (download->sha256sum != NULL)
+        free(download->sha256sum);
+    if (download->digest != NULL)
+        digest_free(download->digest);
+    free(download->name);
+    free(download);
+}
+
+static void fetch_state_done(slapt_src_fetch_state *state, bool ok)
+{
+    if (!ok)
+        state->failed = true;
+
+    if (--state->pending == 0)
+        fetch_state_report(state);
+}
+
+/*
+ * true if filename is already complete.  Otherwise seed is set to the digest
+ * of the partial file to resume, or NULL to start over.
+ */
+static bool download_present(const char *filename, const char *md5sum, const char *sha256sum, slapt_src_digest **seed)
+{
+    *seed = NULL;
+
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+
+    struct stat file_stat;
+    slapt_src_digest *digest = digest_init(sha256sum != NULL);
+    const bool read = digest_update_file(digest, f);
+    const bool shared = fstat(fileno(f), &file_stat) == 0 && file_stat.st_nlink > 1;
+    fclose(f);
+
+    if (read && digest_verify(digest, md5sum, sha256sum, NULL)) {
+        digest_free(digest);
+        return true;
+    }
+
+    /* never append to a file the source store shares with other builds */
+    if (shared)
+        unlink(filename);
+    if (!read || shared) {
+        digest_free(digest);
+        return false;
+    }
+
+    *seed = digest;
+    return false;
+}
+
+static char *store_path(const slapt_src_source_store *store, const char *key, const char *ext)
+{
+    const size_t len = strlen(store->dir) + strlen(key) + strlen(ext) + 2;
+    char *path = slapt_malloc(len);
+    snprintf(path, len, "%s/%s%s", store->dir, key, ext);
+    return path;
+}
+
+/* sha256-<hex> when the source publishes one, md5-<hex> otherwise, NULL for anything malformed */
+static char *store_key(const char *md5sum, const char *sha256sum)
+{
+    const char *prefix = sha256sum != NULL ? "sha256-" : "md5-";
+    const char *sum = sha256sum != NULL ? sha256sum : md5sum;
+    const size_t sum_len = sha256sum != NULL ? SLAPT_SRC_SHA256_STR_LEN : SLAPT_MD5_STR_LEN;
+
+    if (sum == NULL || strlen(sum) != sum_len)
+        return NULL;
+
+    const size_t prefix_len = strlen(prefix);
+    char *key = slapt_malloc(prefix_len + sum_len + 1);
+    memcpy(key, prefix, prefix_len);
+    for (size_t i = 0; i < sum_len; i++) {
+        if (!isxdigit((unsigned char)sum[i])) {
+            free(key);
+            return NULL;
+        }
+        key[prefix_len + i] = (char)tolower((unsigned char)sum[i]);
+    }
+    key[prefix_len + sum_len] = '\0';
+    return key;
+}
+
+/* copy from to a new file at to, sharing its blocks when the filesystem allows */
+static bool copy_file(const char *from, const char *to)
+{
+    const int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in == -1)
+        return false;
+    const int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out == -1) {
+        close(in);
+        return false;
+    }
+
+    bool ok = false;
+#ifdef FICLONE
+    ok = ioctl(out, FICLONE, in) == 0;
+#endif
+    if (!ok) {
+        char buffer[SLAPT_SRC_DIGEST_BUFFER];
+        ssize_t r;
+        ok = true;
+        while ((r = read(in, buffer, sizeof buffer)) > 0) {
+            if (write(out, buffer, (size_t)r) != r) {
+                ok = false;
+                break;
+            }
+        }
+        if (r < 0)
+            ok = false;
+    }
+
+    close(in);
+    if (close(out) != 0)
+        ok = false;
+    if (!ok)
+        unlink(to);
+    return ok;
+}
+
+/* put a store entry at filename, linked when possible */
+static bool store_place(const char *entry, const char *filename)
+{
+    unlink(filename);
+    if (link(entry, filename) == 0)
+        return true;
+    return copy_file(entry, filename);
+}
+
+/* place entry if the store already has it, marking it recently used */
+static bool store_use(const char *entry, const char *name, const char *filename)
+{
+    if (access(entry, F_OK) != 0 || !store_place(entry, filename))
+        return false;
+
+    utimensat(AT_FDCWD, entry, NULL, 0);
+    printf(gettext("Fetching %s..."), name);
+    printf(gettext("Cached\n"));
+    return true;
+}
+
+static void store_waiter_free(void *data)
+{
+    slapt_src_store_waiter *waiter = data;
+    free(waiter->filename);
+    free(waiter);
+}
+
+static void store_fetch_free(void *data)
+{
+    slapt_src_store_fetch *fetch = data;
+    if (fetch->lock_fd != -1)
+        close(fetch->lock_fd);
+    slapt_vector_t_free(fetch->waiters);
+    free(fetch->entry);
+    free(fetch->key);
+    free(fetch);
+}
+
+static void store_fetch_wait(slapt_src_store_fetch *fetch, const char *filename, slapt_src_fetch_state *state)
+{
+    slapt_src_store_waiter *waiter = slapt_malloc(sizeof *waiter);
+    waiter->filename = strdup(filename);
+    waiter->state = state;
+    slapt_vector_t_add(fetch->waiters, waiter);
+    state->pending++;
+    if (fetch->download != NULL)
+        fetch_state_expect(state, fetch->download, true);
+}
+
+/* the store download finished, hand it to every slackbuild waiting on it */
+static void store_fetch_done(slapt_src_store_fetch *fetch, const char *part, bool ok, bool corrupt)
+{
+    if (ok && rename(part, fetch->entry) != 0) {
+        printf(gettext("Failed to store %s\n"), fetch->entry);
+        ok = false;
+    }
+    /* a corrupt download starts over next time, anything else resumes */
+    if (corrupt)
+        unlink(part);
+
+    slapt_vector_t_foreach (slapt_src_store_waiter *, waiter, fetch->waiters) {
+        bool placed = false;
+        if (ok) {
+            placed = store_place(fetch->entry, waiter->filename);
+            if (!placed)
+                printf(gettext("Failed to place %s\n"), waiter->filename);
+        }
+        fetch_state_done(waiter->state, placed);
+    }
+
+    close(fetch->lock_fd);
+    fetch->lock_fd = -1;
+    fetch->download = NULL;
+}
+
+static void source_store_init(slapt_src_source_store *store, const slapt_src_config *config)
+{
+    store->dir = NULL;
+    store->max_size = config->source_cache_size;
+    store->fetching = slapt_vector_t_init(store_fetch_free);
+
+    if (config->source_cache == NULL)
+        return;
+
+    slapt_create_dir_structure(config->source_cache);
+    if (access(config->source_cache, W_OK | X_OK) != 0) {
+        fprintf(stderr, gettext("Unable to use %s%s: %s\n"), SLAPT_SRC_SOURCECACHE_TOKEN, config->source_cache, strerror(errno));
+        return;
+    }
+    store->dir = config->source_cache;
+}
+
+/*
+ * hold the lock on key without waiting, -1 if someone else has it.  Eviction
+ * unlinks locks nobody holds, so a lock that went while it was being taken
+ * is taken again from the file now at its path.
+ */
+static int store_lock(const slapt_src_source_store *store, const char *key)
+{
+    char *lock = store_path(store, key, SLAPT_SRC_STORE_LOCK_EXT);
+    for (;;) {
+        const int lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock_fd == -1 || flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+            if (lock_fd != -1)
+                close(lock_fd);
+            free(lock);
+            return -1;
+        }
+
+        struct stat held, current;
+        if (fstat(lock_fd, &held) == 0 && stat(lock, &current) == 0 && held.st_dev == current.st_dev && held.st_ino == current.st_ino) {
+            free(lock);
+            return lock_fd;
+        }
+        close(lock_fd);
+    }
+}
+
+/* fetch filename through the store, false if the store cannot take it */
+static bool source_store_queue(
+    slapt_src_transfer_pool *pool,
+    slapt_src_source_store *store,
+    const char *url,
+    const char *filename,
+    const char *md5sum,
+    const char *sha256sum,
+    slapt_src_fetch_state *state)
+{
+    char *key = store_key(md5sum, sha256sum);
+    if (key == NULL)
+        return false;
+
+    /* another slackbuild in the set already needs the same source */
+    slapt_vector_t_foreach (slapt_src_store_fetch *, fetching, store->fetching) {
+        if (fetching->lock_fd != -1 && strcmp(fetching->key, key) == 0) {
+            store_fetch_wait(fetching, filename, state);
+            free(key);
+            return true;
+        }
+    }
+
+    char *entry = store_path(store, key, "");
+    if (store_use(entry, url, filename)) {
+        free(entry);
+        free(key);
+        return true;
+    }
+
+    /* another slapt-src is downloading it, fall back to our own copy */
+    const int lock_fd = store_lock(store, key);
+    if (lock_fd == -1) {
+        free(entry);
+        free(key);
+        return false;
+    }
+
+    /* it may have completed before we held the lock, or only missed being renamed */
+    char *part = store_path(store, key, SLAPT_SRC_STORE_PART_EXT);
+    slapt_src_digest *seed = NULL;
+    if (store_use(entry, url, filename) ||
+        (download_present(part, md5sum, sha256sum, &seed) && rename(part, entry) == 0 && store_use(entry, url, filename))) {
+        close(lock_fd);
+        free(part);
+        free(entry);
+        free(key);
+        return true;
+    }
+
+    slapt_src_store_fetch *fetch = slapt_malloc(sizeof *fetch);
+    fetch->key = key;
+    fetch->entry = entry;
+    fetch->lock_fd = lock_fd;
+    fetch->download = NULL;
+    fetch->waiters = slapt_vector_t_init(store_waiter_free);
+    slapt_vector_t_add(store->fetching, fetch);
+    store_fetch_wait(fetch, filename, state);
+
+    slapt_src_download *download = download_init(url, md5sum, sha256sum, seed, NULL);
+    download->store_fetch = fetch;
+    queue_download(pool, url, part, download);
+    free(part);
+    return true;
+}
+
+typedef struct _slapt_src_store_file_ {
+    char *name;
+    uint64_t size;
+    struct timespec mtime;
+} slapt_src_store_file;
+
+static void store_file_free(void *data)
+{
+    slapt_src_store_file *file = data;
+    free(file->name);
+    free(file);
+}
+
+static int store_file_cmp(const void *a, const void *b)
+{
+    const slapt_src_store_file *f1 = *(const slapt_src_store_file *const *)a;
+    const slapt_src_store_file *f2 = *(const slapt_src_store_file *const *)b;
+
+    if (f1->mtime.tv_sec != f2->mtime.tv_sec)
+        return f1->mtime.tv_sec < f2->mtime.tv_sec ? -1 : 1;
+    if (f1->mtime.tv_nsec != f2->mtime.tv_nsec)
+        return f1->mtime.tv_nsec < f2->mtime.tv_nsec ? -1 : 1;
+    return strcmp(f1->name, f2->name);
+}
+
+static bool has_suffix(const char *s, const char *suffix)
+{
+    const size_t len = strlen(s), suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+/* remove the least recently used sources until the store fits its size */
+static void source_store_evict(const slapt_src_source_store *store)
+{
+    if (store->dir == NULL)
+        return;
+
+    DIR *dir = opendir(store->dir);
+    if (dir == NULL)
+        return;
+
+    slapt_vector_t *files = slapt_vector_t_init(store_file_free);
+    slapt_vector_t *locks = slapt_vector_t_init(free);
+    uint64_t total = 0;
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL) {
+        struct stat file_stat;
+        if (dent->d_name[0] == '.')
+            continue;
+        if (has_suffix(dent->d_name, SLAPT_SRC_STORE_LOCK_EXT)) {
+            slapt_vector_t_add(locks, strdup(dent->d_name));
+            continue;
+        }
+        if (fstatat(dirfd(dir), dent->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(file_stat.st_mode))
+            continue;
+
+        slapt_src_store_file *file = slapt_malloc(sizeof *file);
+        file->name = strdup(dent->d_name);
+        file->size = (uint64_t)file_stat.st_size;
+        file->mtime = file_stat.st_mtim;
+        slapt_vector_t_add(files, file);
+        total += file->size;
+    }
+
+    if (total > store->max_size) {
+        slapt_vector_t_sort(files, store_file_cmp);
+        slapt_vector_t_foreach (const slapt_src_store_file *, file, files) {
+            if (total <= store->max_size)
+                break;
+
+            /* partial downloads go only when nobody is still writing them */
+            int lock_fd = -1;
+            if (has_suffix(file->name, SLAPT_SRC_STORE_PART_EXT)) {
+                const size_t key_len = strlen(file->name) - strlen(SLAPT_SRC_STORE_PART_EXT);
+                char *key = strndup(file->name, key_len);
+                char *lock = store_path(store, key, SLAPT_SRC_STORE_LOCK_EXT);
+                lock_fd = open(lock, O_RDWR | O_CLOEXEC);
+                free(lock);
+                free(key);
+                if (lock_fd != -1 && flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+                    close(lock_fd);
+                    continue;
+                }
+            }
+
+            if (unlinkat(dirfd(dir), file->name, 0) == 0)
+                total -= file->size;
+            if (lock_fd != -1)
+                close(lock_fd);
+        }
+    }
+
+    /*
+     * a lock whose entry is gone goes too, unless someone holds it.  Whoever
+     * opened it just before it was unlinked sees that once they have the lock
+     * and opens it again, see store_lock.
+     */
+    slapt_vector_t_foreach (const char *, lock, locks) {
+        const size_t key_len = strlen(lock) - strlen(SLAPT_SRC_STORE_LOCK_EXT);
+        char *key = strndup(lock, key_len);
+        char *part = store_path(store, key, SLAPT_SRC_STORE_PART_EXT);
+        struct stat file_stat;
+        const bool in_use = fstatat(dirfd(dir), key, &file_stat, 0) == 0 || stat(part, &file_stat) == 0;
+        free(part);
+        free(key);
+        if (in_use)
+            continue;
+
+        const int lock_fd = openat(dirfd(dir), lock, O_RDWR | O_CLOEXEC);
+        if (lock_fd == -1)
+            continue;
+        if (flock(lock_fd, LOCK_EX | LOCK_NB) == 0)
+            unlinkat(dirfd(dir), lock, 0);
+        close(lock_fd);
+    }
+
+    slapt_vector_t_free(locks);
+    slapt_vector_t_free(files);
+    closedir(dir);
+}
+
+static void source_store_free(slapt_src_source_store *store)
+{
+    slapt_vector_t_free(store->fetching);
+}
+
+static void download_done(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer)
+{
+    slapt_src_download *download = transfer->data;
+
+    /* a partial file the server will not resume, start it over */
+    if (!transfer->ok && transfer->resume_from > 0 &&
+        (transfer->result == CURLE_RANGE_ERROR || transfer->result == CURLE_BAD_DOWNLOAD_RESUME || transfer->response_code == 416)) {
+        download_expect(download, false);
+        slapt_src_download *retry = download_init(download->name, download->md5sum, download->sha256sum, NULL, download->state);
+        retry->store_fetch = download->store_fetch;
+        queue_download(pool, transfer->url, transfer->filename, retry);
+        if (download->state != NULL)
+            download->state->pending--;
+        download_free(download);
+        return;
+    }
+
+    bool ok = transfer->ok, corrupt = false;
+    slapt_src_stats_transfer(download->name, transfer->seconds, transfer->downloaded);
+    printf(gettext("Fetching %s..."), download->name);
+    if (!ok) {
+        printf(gettext("Failed\n"));
+    } else {
+        printf(gettext("Done\n"));
+
+        /* verify checksum of downloaded file */
+        if (download->md5sum != NULL) {
+            /* the partial file changed between hashing and resuming, hash it over */
+            if (transfer->resume_from != download->seeded) {
+                digest_free(download->digest);
+                download->digest = digest_init(download->sha256sum != NULL);
+                if (!digest_update_file(download->digest, transfer->fh))
+                    ok = false;
+            }
+            /* name the file the user knows about, not its place in the store */
+            const char *filename = transfer->filename;
+            if (download->store_fetch != NULL)
+                filename = ((const slapt_src_store_waiter *)download->store_fetch->waiters->items[0])->filename;
+            if (ok && !digest_verify(download->digest, download->md5sum, download->sha256sum, filename)) {
+                ok = false;
+                corrupt = true;
+            }
+        }
+
+        struct stat file_stat;
+        if (stat(transfer->filename, &file_stat) == 0)
+            download_sized(download, (uint64_t)file_stat.st_size);
+    }
+
+    /* without a Content-Length the size is only known now */
+    if (!download->sized)
+        download_sized(download, download->counted);
+
+    if (download->store_fetch != NULL)
+        store_fetch_done(download->store_fetch, transfer->filename, ok, corrupt);
+    else
+        fetch_state_done(download->state, ok);
+    download_free(download);
+}
+
+/*
+ * queue everything sb needs under its location in the build directory.
+ * false when its downloads and checksums do not line up, anything already
+ * queued still runs and state is marked failed.
+ */
+static bool queue_slackbuild_downloads(slapt_src_transfer_pool *pool, slapt_src_source_store *store, const slapt_src_slackbuild *sb, slapt_src_fetch_state *state)
+{
+    slapt_create_dir_structure(sb->location);
+
+    /* download slackbuild files */
+    char *sb_location = add_part_to_url(sb->sb_source_url, sb->location);
+    slapt_vector_t_foreach(const char *, sb_file, sb->files) {
+        char *s = NULL, *url = add_part_to_url(sb_location, sb_file);
+        char *filename = add_part_to_url(sb->location, sb_file);
+
+        /* some files contain paths, create as necessary */
+        if ((s = rindex(filename, '/')) != NULL) {
+            char *initial_dir = strndup(filename, strlen(filename) - strlen(s) + 1);
+            if (initial_dir != NULL) {
+                slapt_create_dir_structure(initial_dir);
+                free(initial_dir);
+            }
+        }
+
+        queue_download(pool, url, filename, download_init(sb_file, NULL, NULL, NULL, state));
+        free(filename);
+        free(url);
+    }
+    free(sb_location);
+
+    /* fetch download || download_x86_64 */
+    slapt_vector_t *download_parts = NULL, *md5sum_parts = NULL, *sha256sum_parts = NULL;
+    if (uses_x86_64_download(sb)) {
+        download_parts = slapt_parse_delimited_list(sb->download_x86_64, ' ');
+        md5sum_parts = slapt_parse_delimited_list(sb->md5sum_x86_64, ' ');
+        if (sb->sha256sum_x86_64 != NULL && strcmp(sb->sha256sum_x86_64, "") != 0)
+            sha256sum_parts = slapt_parse_delimited_list(sb->sha256sum_x86_64, ' ');
+    } else {
+        if (sb->download != NULL)
+            download_parts = slapt_parse_delimited_list(sb->download, ' ');
+        else
+            download_parts = slapt_vector_t_init(free); /* no download files */
+
+        if (sb->md5sum != NULL)
+            md5sum_parts = slapt_parse_delimited_list(sb->md5sum, ' ');
+        else
+            md5sum_parts = slapt_vector_t_init(free); /* no md5sum files */
+
+        if (sb->sha256sum != NULL && strcmp(sb->sha256sum, "") != 0)
+            sha256sum_parts = slapt_parse_delimited_list(sb->sha256sum, ' ');
+    }
+
+    bool mismatch = false;
+    if (download_parts == NULL || md5sum_parts == NULL || download_parts->size != md5sum_parts->size) {
+        printf(gettext("Mismatch between download files and md5sums\n"));
+        mismatch = true;
+    } else if (sha256sum_parts != NULL && sha256sum_parts->size != download_parts->size) {
+        printf(gettext("Mismatch between download files and sha256sums\n"));
+        mismatch = true;
+    }
+    if (mismatch) {
+        if (download_parts != NULL)
+            slapt_vector_t_free(download_parts);
+        if (md5sum_parts != NULL)
+            slapt_vector_t_free(md5sum_parts);
+        if (sha256sum_parts != NULL)
+            slapt_vector_t_free(sha256sum_parts);
+        state->failed = true;
+        return false;
+    }
+    sums_tolower(md5sum_parts);
+    if (sha256sum_parts != NULL)
+        sums_tolower(sha256sum_parts);
+
+    /* what is already there is checked now, downloads are hashed as they arrive */
+    slapt_src_stats_sample sample;
+    slapt_src_stats_start(&sample);
+    for (uint32_t i = 0; i < download_parts->size; i++) {
+        const char *url = download_parts->items[i];
+        const char *md5sum = md5sum_parts->items[i];
+        const char *sha256sum = sha256sum_parts != NULL ? sha256sum_parts->items[i] : NULL;
+
+        char *basename = filename_from_url(download_parts->items[i]);
+        char *filename = add_part_to_url(sb->location, basename);
+        free(basename);
+
+        /* check checksum of what we already have to see if we need to continue,
+           a partial file seeds the digest the rest of the download is added to */
+        slapt_src_digest *seed = NULL;
+        if (download_present(filename, md5sum, sha256sum, &seed)) {
+            /* keep it for the next build needing the same source */
+            if (store->dir != NULL) {
+                char *key = store_key(md5sum, sha256sum);
+                if (key != NULL) {
+                    char *entry = store_path(store, key, "");
+                    if (link(filename, entry) != 0 && errno == EEXIST)
+                        utimensat(AT_FDCWD, entry, NULL, 0);
+                    free(entry);
+                    free(key);
+                }
+            }
+            free(filename);
+            continue;
+        }
+
+        if (store->dir != NULL && source_store_queue(pool, store, url, filename, md5sum, sha256sum, state)) {
+            if (seed != NULL)
+                digest_free(seed);
+            free(filename);
+            continue;
+        }
+
+        queue_download(pool, url, filename, download_init(url, md5sum, sha256sum, seed, state));
+        free(filename);
+    }
+    if (download_parts->size > 0)
+        slapt_src_stats_stop(&sample, "verify", sb->name);
+
+    slapt_vector_t_free(download_parts);
+    if (md5sum_parts != NULL)
+        slapt_vector_t_free(md5sum_parts);
+    if (sha256sum_parts != NULL)
+        slapt_vector_t_free(sha256sum_parts);
+    return true;
+}
+
+static void fetch_slackbuilds(const slapt_src_config *config, const slapt_src_slackbuild *const *sbs, uint32_t count)
+{
+    bool failed = false;
+    slapt_src_fetch_state *states = calloc(count + 1, sizeof *states);
+    if (states == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+
+    slapt_src_source_store store;
+    source_store_init(&store, config);
+
+    slapt_src_transfer_pool *pool = slapt_src_transfer_pool_init(SLAPT_SRC_MAX_TRANSFERS, SLAPT_SRC_MAX_HOST_TRANSFERS);
+    for (uint32_t i = 0; i < count; i++) {
+        states[i].report_fd = -1;
+        if (!queue_slackbuild_downloads(pool, &store, sbs[i], &states[i]))
+            exit(EXIT_FAILURE);
+    }
+    slapt_src_transfer_pool_run(pool);
+    slapt_src_transfer_pool_free(pool);
 
-    /* need to mkdir and chdir to sb->location */
-    slapt_create_dir_structure(sb->location);
-    if (chdir(sb->location) != 0) {
-        printf(gettext("Failed to chdir to %s\n"), sb->location);
-        exit(EXIT_FAILURE);
+    source_store_evict(&store);
+    source_store_free(&store);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (states[i].failed)
+            failed = true;
     }
+    free(states);
 
-    /* download slackbuild files */
-    slapt_config_t *slapt_config = slapt_config_t_init();
-    char *sb_location = add_part_to_url(sb->sb_source_url, sb->location);
-    slapt_vector_t_foreach(const char *, sb_file, sb->files) {
-        char *s = NULL, *url = add_part_to_url(sb_location, sb_file);
-        FILE *f = NULL;
+    if (failed)
+        exit(EXIT_FAILURE);
+}
 
-        /* some files contain paths, create as necessary */
-        if ((s = rindex(sb_file, '/')) != NULL) {
-            char *initial_dir = strndup(sb_file, strlen(sb_file) - strlen(s) + 1);
-            if (initial_dir != NULL) {
-                slapt_create_dir_structure(initial_dir);
-                free(initial_dir);
+void slapt_src_fetch_slackbuilds(const slapt_src_config *config, const slapt_vector_t *sbs)
+{
+    fetch_slackbuilds(config, (const slapt_src_slackbuild *const *)sbs->items, sbs->size);
+}
+
+struct _slapt_src_prefetch_ {
+    const slapt_src_config *config;
+    const slapt_vector_t *sbs;
+    pid_t pid;
+    int request_fd; /* index of the slackbuild about to be built */
+    int report_fd;  /* slapt_src_prefetch_report as each completes */
+    uint8_t *ready; /* 0 pending, 1 fetched, 2 failed */
+    uint32_t count;
+    bool gone; /* the prefetch process died, fetch here instead */
+};
+
+/* runs in the prefetch process, keeps up to config->prefetch slackbuilds fetched ahead of the one being built */
+static void prefetch_worker(const slapt_src_config *config, const slapt_vector_t *sbs, int request_fd, int report_fd)
+{
+    slapt_src_fetch_state *states = calloc(sbs->size + 1, sizeof *states);
+    if (states == NULL)
+        _exit(EXIT_FAILURE);
+
+    slapt_src_stats_sample sample;
+    slapt_src_stats_start(&sample);
+
+    slapt_src_source_store store;
+    source_store_init(&store, config);
+
+    slapt_src_transfer_pool *pool = slapt_src_transfer_pool_init(SLAPT_SRC_MAX_TRANSFERS, SLAPT_SRC_MAX_HOST_TRANSFERS);
+    uint32_t current = 0, next = 0;
+    for (;;) {
+        /*
+         * whatever is being built is always fetched, anything further ahead
+         * has to fit the budget.  That waits until the size of everything
+         * already queued ahead is known, from its Content-Length or once it
+         * has completed, so queued downloads count before any of their bytes
+         * are in.
+         */
+        while (next < sbs->size && next <= current + config->prefetch) {
+            if (next > current) {
+                uint64_t ahead = 0;
+                bool unsized = false;
+                for (uint32_t i = current + 1; i < next; i++) {
+                    ahead += states[i].expected;
+                    if (states[i].unsized > 0)
+                        unsized = true;
+                }
+                if (unsized || ahead >= config->prefetch_size)
+                    break;
             }
-        }
-        f = slapt_open_file(sb_file, "w+b");
 
-        if (f == NULL) {
-            perror("Cannot open file for writing");
-            exit(EXIT_FAILURE);
+            states[next].index = next;
+            states[next].report_fd = report_fd;
+            /* a failure to queue is reported like any other failed download */
+            queue_slackbuild_downloads(pool, &store, sbs->items[next], &states[next]);
+            if (states[next].pending == 0)
+                fetch_state_report(&states[next]);
+            next++;
         }
 
-        /* TODO support file resume */
-        printf(gettext("Fetching %s..."), sb_file);
-        const int curl_rv = slapt_download_data(f, url, 0, NULL, slapt_config);
-        if (curl_rv == 0) {
-            printf(gettext("Done\n"));
-        } else {
-            printf(gettext("Failed\n"));
-            exit(EXIT_FAILURE);
-        }
+        struct curl_waitfd request = {.fd = request_fd, .events = CURL_WAIT_POLLIN, .revents = 0};
+        slapt_src_transfer_pool_step(pool, &request, 1);
 
-        free(url);
-        fclose(f);
+        if (request.revents & CURL_WAIT_POLLIN) {
+            uint32_t index = 0;
+            const ssize_t r = read(request_fd, &index, sizeof index);
+            if (r != sizeof index) /* the build side is gone */
+                break;
+            if (index > current)
+                current = index;
+        }
     }
 
-    /* fetch download || download_x86_64 */
-    slapt_vector_t *download_parts = NULL, *md5sum_parts = NULL;
-    if (strcmp(uname_v.machine, "x86_64") == 0 && sb->download_x86_64 != NULL && strcmp(sb->download_x86_64, "") != 0 && strcmp(sb->download_x86_64, "UNSUPPORTED") != 0 && strcmp(sb->download_x86_64, "UNTESTED") != 0) {
-        download_parts = slapt_parse_delimited_list(sb->download_x86_64, ' ');
-        md5sum_parts = slapt_parse_delimited_list(sb->md5sum_x86_64, ' ');
-    } else {
-        if (sb->download != NULL)
-            download_parts = slapt_parse_delimited_list(sb->download, ' ');
-        else
-            download_parts = slapt_vector_t_init(free); /* no download files */
+    slapt_src_transfer_pool_free(pool);
+    source_store_evict(&store);
+    source_store_free(&store);
+    free(states);
 
-        if (sb->md5sum != NULL)
-            md5sum_parts = slapt_parse_delimited_list(sb->md5sum, ' ');
-        else
-            md5sum_parts = slapt_vector_t_init(free); /* no md5sum files */
-    }
+    slapt_src_stats_stop(&sample, "prefetch", NULL);
+    _exit(EXIT_SUCCESS);
+}
 
-    if (download_parts == NULL || download_parts->size != md5sum_parts->size) {
-        printf(gettext("Mismatch between download files and md5sums\n"));
+slapt_src_prefetch *slapt_src_prefetch_start(const slapt_src_config *config, const slapt_vector_t *sbs)
+{
+    int request_pipe[2], report_pipe[2];
+    if (pipe(request_pipe) == -1 || pipe(report_pipe) == -1) {
+        perror("pipe");
         exit(EXIT_FAILURE);
     }
 
-    for (uint32_t i = 0; i < download_parts->size; i++) {
-        const char *md5sum = md5sum_parts->items[i];
-
-        char *filename = filename_from_url(download_parts->items[i]);
-        struct stat file_stat;
-        size_t file_size = 0;
-        if (stat(filename, &file_stat) == 0) {
-            /* if already exists, find out how much we already have */
-            file_size = (size_t)file_stat.st_size;
-        }
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
 
-        FILE *f = slapt_open_file(filename, "a+b");
-        if (f == NULL) {
-            perror("Cannot open file for writing");
-            exit(EXIT_FAILURE);
-        }
+    if (pid == 0) {
+        close(request_pipe[1]);
+        close(report_pipe[0]);
+        prefetch_worker(config, sbs, request_pipe[0], report_pipe[1]);
+    }
 
-        /* check checksum to see if we need to continue */
-        char md5sum_to_prove[SLAPT_MD5_STR_LEN + 1];
-        slapt_gen_md5_sum_of_file(f, md5sum_to_prove);
-        if (strcmp(md5sum_to_prove, md5sum) != 0) {
-            printf(gettext("Fetching %s..."), (char *)download_parts->items[i]);
-            /* download/resume */
-            const int curl_rv = slapt_download_data(f, download_parts->items[i], file_size, NULL, slapt_config);
-            if (curl_rv == 0) {
-                printf(gettext("Done\n"));
-            } else {
-                printf(gettext("Failed\n"));
-                exit(EXIT_FAILURE);
-            }
+    close(request_pipe[0]);
+    close(report_pipe[1]);
+
+    slapt_src_prefetch *prefetch = slapt_malloc(sizeof *prefetch);
+    prefetch->config = config;
+    prefetch->sbs = sbs;
+    prefetch->pid = pid;
+    prefetch->request_fd = request_pipe[1];
+    prefetch->report_fd = report_pipe[0];
+    prefetch->count = sbs->size;
+    prefetch->gone = false;
+    prefetch->ready = calloc(sbs->size + 1, sizeof *prefetch->ready);
+    if (prefetch->ready == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+    return prefetch;
+}
 
-            /* verify checksum of downloaded file */
-            slapt_gen_md5_sum_of_file(f, md5sum_to_prove);
-            if (strcmp(md5sum_to_prove, md5sum) != 0) {
-                printf(gettext("MD5SUM mismatch for %s\n"), filename);
-                exit(EXIT_FAILURE);
-            }
+bool slapt_src_prefetch_wait(slapt_src_prefetch *prefetch, uint32_t index)
+{
+    if (index >= prefetch->count)
+        return false;
+
+    /* moves the window forward, and makes sure index itself is being fetched.
+       SIGPIPE is ignored, a prefetch process that died leaves EPIPE or EOF */
+    if (!prefetch->gone && write(prefetch->request_fd, &index, sizeof index) != sizeof index)
+        prefetch->gone = true;
+
+    while (!prefetch->gone && prefetch->ready[index] == 0) {
+        slapt_src_prefetch_report report;
+        const ssize_t r = read(prefetch->report_fd, &report, sizeof report);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r != sizeof report || report.index >= prefetch->count) {
+            prefetch->gone = true;
+            break;
         }
+        prefetch->ready[report.index] = report.ok ? 1 : 2;
+    }
 
-        fclose(f);
-        free(filename);
+    /* whatever the prefetch process did not get to is fetched here */
+    if (prefetch->ready[index] == 0) {
+        const slapt_src_slackbuild *sb = prefetch->sbs->items[index];
+        fetch_slackbuilds(prefetch->config, &sb, 1);
+        prefetch->ready[index] = 1;
     }
 
-    slapt_vector_t_free(download_parts);
-    if (md5sum_parts != NULL)
-        slapt_vector_t_free(md5sum_parts);
+    return prefetch->ready[index] == 1;
+}
 
-    slapt_config_t_free(slapt_config);
-    free(sb_location);
+void slapt_src_prefetch_free(slapt_src_prefetch *prefetch)
+{
+    close(prefetch->request_fd);
+    close(prefetch->report_fd);
+    waitpid(prefetch->pid, NULL, 0);
+    free(prefetch->ready);
+    free(prefetch);
+}
+
+bool slapt_src_show_slackbuild_readme(const slapt_src_config *config, const slapt_src_catalog *catalog, const slapt_src_slackbuild *sb)
+{
+    bool rv = true;
 
-    /* maybe show the README here */
-    if (sb->requires && strstr(sb->requires, "%README%") != NULL) {
+    /* maybe show the README here, %README% in REQUIRES was noted when the catalog was built */
+    const uint32_t position = slapt_src_catalog_position(catalog, sb);
+    if (position != UINT32_MAX && catalog->requires[position].has_readme) {
         printf("%%README%%\n");
-        FILE *readme = slapt_open_file("README", "r");
+        char *readme_file = add_part_to_url(sb->location, "README");
+        FILE *readme = slapt_open_file(readme_file, "r");
+        free(readme_file);
         if (readme == NULL) {
             exit(EXIT_FAILURE);
         }
@@ -653,14 +3036,13 @@ bool slapt_src_fetch_slackbuild(const slapt_src_config *config, const slapt_src_
         }
     }
 
-    /* go back */
-    if (chdir(config->builddir) != 0) {
-        printf(gettext("Failed to chdir to %s\n"), config->builddir);
-        exit(EXIT_FAILURE);
-    }
     return rv;
 }
 
+/* compilers ccache stands in for, when they are installed */
+static const char *const ccache_compilers[] = {"cc", "gcc", "c++", "g++", "clang", "clang++", NULL};
+#define SLAPT_SRC_CCACHE_STATS_LOG ".ccache-stats"
+
 /* reads directory listing of current directory for a package */
 static char *_get_pkg_filename(const char *version, const char *pkgtag)
 {
@@ -714,79 +3096,662 @@ static char *_get_pkg_filename(const char *version, const char *pkgtag)
     return filename;
 }
 
+static void recipe_update(EVP_MD_CTX *ctx, const char *field)
+{
+    if (field == NULL)
+        field = "";
+    /* the NUL keeps one field from running into the next */
+    EVP_DigestUpdate(ctx, field, strlen(field) + 1);
+}
+
+/*
+ * where the package cache keeps what building sb in the current directory
+ * produces, keyed by everything going into it: name, version, the contents
+ * of its files, its source MD5SUMs, PKGEXT, PKGTAG and ARCH.  NULL if the
+ * files cannot be read.
+ */
+static char *pkg_cache_dir(const slapt_src_config *config, const slapt_src_slackbuild *sb)
+{
+    EVP_MD_CTX *ctx = digest_ctx_init(EVP_sha256());
+    recipe_update(ctx, sb->name);
+    recipe_update(ctx, sb->version);
+
+    char *buffer = slapt_malloc(SLAPT_SRC_DIGEST_BUFFER);
+    bool ok = true;
+    slapt_vector_t_foreach (const char *, sb_file, sb->files) {
+        recipe_update(ctx, sb_file);
+        FILE *f = fopen(sb_file, "rb");
+        if (f == NULL) {
+            ok = false;
+            break;
+        }
+
+        size_t len = 0, total = 0;
+        while ((len = fread(buffer, 1, SLAPT_SRC_DIGEST_BUFFER, f)) > 0) {
+            EVP_DigestUpdate(ctx, buffer, len);
+            total += len;
+        }
+        if (ferror(f))
+            ok = false;
+        fclose(f);
+
+        char size[32];
+        snprintf(size, sizeof size, "%zu", total);
+        recipe_update(ctx, size);
+    }
+    free(buffer);
+
+    recipe_update(ctx, uses_x86_64_download(sb) ? sb->md5sum_x86_64 : sb->md5sum);
+    recipe_update(ctx, config->pkgext);
+    recipe_update(ctx, config->pkgtag);
+    const char *arch = uses_x86_64_download(sb) ? uname_v.machine : getenv("ARCH");
+    recipe_update(ctx, arch != NULL ? arch : uname_v.machine);
+
+    char key[SLAPT_SRC_SHA256_STR_LEN + 1];
+    digest_ctx_hex(ctx, key);
+    EVP_MD_CTX_free(ctx);
+    if (!ok)
+        return NULL;
+
+    const size_t len = strlen(config->pkg_cache) + strlen(sb->name) + sizeof key + 2;
+    char *dir = slapt_malloc(len);
+    snprintf(dir, len, "%s/%s/%s", config->pkg_cache, sb->name, key);
+    return dir;
+}
+
+/* copy a cached package into the current directory, returning its name */
+static char *pkg_cache_restore(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return NULL;
+
+    char *filename = NULL;
+    struct dirent *file = NULL;
+    while ((file = readdir(d)) != NULL) {
+        /* skips . and .., and packages still being stored */
+        if (file->d_name[0] == '.')
+            continue;
+
+        const size_t len = strlen(dir) + strlen(file->d_name) + 2;
+        char *cached = slapt_malloc(len);
+        snprintf(cached, len, "%s/%s", dir, file->d_name);
+        unlink(file->d_name);
+        if (copy_file(cached, file->d_name))
+            filename = strdup(file->d_name);
+        free(cached);
+        break;
+    }
+
+    closedir(d);
+    return filename;
+}
+
+/* keep the package just built, written aside and renamed so readers never see part of it */
+static void pkg_cache_store(const char *dir, const char *filename)
+{
+    slapt_create_dir_structure(dir);
+
+    const size_t len = strlen(dir) + strlen(filename) + 32;
+    char *tmp = slapt_malloc(len), *cached = slapt_malloc(len);
+    snprintf(tmp, len, "%s/.%s.%ld", dir, filename, (long)getpid());
+    snprintf(cached, len, "%s/%s", dir, filename);
+
+    if (!copy_file(filename, tmp) || rename(tmp, cached) != 0) {
+        unlink(tmp);
+        printf(gettext("Failed to cache %s\n"), filename);
+    }
+
+    free(cached);
+    free(tmp);
+}
+
+/* first executable name in PATH, leaving out skip_dir */
+static char *find_in_path(const char *name, const char *skip_dir)
+{
+    const char *path = getenv("PATH");
+    if (path == NULL)
+        return NULL;
+
+    char *dirs = strdup(path), *save = NULL;
+    for (char *dir = strtok_r(dirs, ":", &save); dir != NULL; dir = strtok_r(NULL, ":", &save)) {
+        if (skip_dir != NULL && strcmp(dir, skip_dir) == 0)
+            continue;
+
+        const size_t len = strlen(dir) + strlen(name) + 2;
+        char *candidate = slapt_malloc(len);
+        snprintf(candidate, len, "%s/%s", dir, name);
+        if (access(candidate, X_OK) == 0) {
+            free(dirs);
+            return candidate;
+        }
+        free(candidate);
+    }
+
+    free(dirs);
+    return NULL;
+}
+
+/*
+ * send compilations through ccache: a directory of links to it, named after
+ * each installed compiler, goes first in command's PATH, and ccache invoked
+ * through one runs the real compiler found further along.  Returns where this
+ * build's ccache statistics are logged, NULL without ccache.
+ */
+static char *ccache_setup(const slapt_src_config *config, slapt_src_command *command, const char *location)
+{
+    const size_t bin_len = strlen(config->ccache_dir) + 5;
+    char *bin = slapt_malloc(bin_len);
+    snprintf(bin, bin_len, "%s/bin", config->ccache_dir);
+
+    char *ccache = find_in_path("ccache", bin);
+    if (ccache == NULL) {
+        printf(gettext("ccache not found, building without it\n"));
+        free(bin);
+        return NULL;
+    }
+
+    slapt_create_dir_structure(bin);
+    for (const char *const *compiler = ccache_compilers; *compiler != NULL; compiler++) {
+        char *real = find_in_path(*compiler, bin);
+        if (real == NULL)
+            continue;
+        free(real);
+
+        const size_t len = bin_len + strlen(*compiler) + 32;
+        char *link_path = slapt_malloc(len), *target = slapt_malloc(PATH_MAX);
+        snprintf(link_path, len, "%s/%s", bin, *compiler);
+
+        /* builds running in parallel may be using it, replace it in one step */
+        const ssize_t target_len = readlink(link_path, target, PATH_MAX - 1);
+        if (target_len < 0 || (size_t)target_len != strlen(ccache) || strncmp(target, ccache, (size_t)target_len) != 0) {
+            char *tmp = slapt_malloc(len);
+            snprintf(tmp, len, "%s.%ld", link_path, (long)getpid());
+            unlink(tmp);
+            if (symlink(ccache, tmp) != 0 || rename(tmp, link_path) != 0)
+                unlink(tmp);
+            free(tmp);
+        }
+        free(target);
+        free(link_path);
+    }
+    free(ccache);
+
+    slapt_src_command_setenv(command, "CCACHE_DIR", config->ccache_dir);
+
+    const char *path = slapt_src_command_getenv(command, "PATH");
+    const size_t path_len = strlen(bin) + (path != NULL ? strlen(path) : 0) + 2;
+    char *new_path = slapt_malloc(path_len);
+    snprintf(new_path, path_len, "%s:%s", bin, path != NULL ? path : "");
+    slapt_src_command_setenv(command, "PATH", new_path);
+    free(new_path);
+    free(bin);
+
+    const size_t log_len = strlen(location) + strlen(SLAPT_SRC_CCACHE_STATS_LOG) + 2;
+    char *log = slapt_malloc(log_len);
+    snprintf(log, log_len, "%s/%s", location, SLAPT_SRC_CCACHE_STATS_LOG);
+
+    unlink(log);
+    slapt_src_command_setenv(command, "CCACHE_STATSLOG", log);
+    return log;
+}
+
+/*
+ * count the hits and misses ccache logged for sb.  Each compilation logs
+ * several counters, one per line, and newer ccache adds storage level ones
+ * such as local_storage_hit.  Only the result counters say how it went.
+ */
+static void ccache_report(const slapt_src_slackbuild *sb, const char *log)
+{
+    FILE *f = fopen(log, "r");
+    if (f == NULL)
+        return;
+
+    uint32_t hits = 0, misses = 0;
+    char *line = NULL;
+    size_t line_len = 0;
+    while (getline(&line, &line_len, f) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strcmp(line, "direct_cache_hit") == 0 || strcmp(line, "preprocessed_cache_hit") == 0)
+            hits++;
+        else if (strcmp(line, "cache_miss") == 0)
+            misses++;
+    }
+    if (line != NULL)
+        free(line);
+    fclose(f);
+    unlink(log);
+
+    if (hits + misses > 0)
+        printf(gettext("%s: %u of %u compilations from ccache\n"), sb->name, hits, hits + misses);
+}
+
+/*
+ * build scratch on a tmpfs: TMP moves to a directory of its own there when
+ * what the slackbuild needed last time, or a guess from the size of its
+ * files without history, fits in both the tmpfs and half of the memory
+ * available.  Packages are still written to OUTPUT under BUILDDIR.  The
+ * space each build used is remembered in BUILDDIR for the next one, and
+ * what builds still running expect to use is reserved there by pid so
+ * builds starting side by side do not all count the same free space.  Only
+ * the part of a reservation its scratch does not use yet is held back.
+ */
+#define SLAPT_SRC_SCRATCH_HISTORY ".slapt-src-scratch"
+#define SLAPT_SRC_SCRATCH_RESERVED ".slapt-src-scratch-reserved"
+#define SLAPT_SRC_SCRATCH_EXPANSION 4 /* scratch per byte of files, without history */
+#define SLAPT_SRC_SCRATCH_FULL ((size_t)64 * 1024 * 1024)
+
+/* add the disk space used under the directory open as dir_fd to total, dir_fd is closed */
+static void dir_size_add(int dir_fd, size_t *total)
+{
+    DIR *dir = fdopendir(dir_fd);
+    if (dir == NULL) {
+        close(dir_fd);
+        return;
+    }
+
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL) {
+        struct stat file_stat;
+        if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
+            continue;
+        if (fstatat(dirfd(dir), dent->d_name, &file_stat, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+        *total += (size_t)file_stat.st_blocks * 512;
+        if (S_ISDIR(file_stat.st_mode)) {
+            const int sub_fd = openat(dirfd(dir), dent->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (sub_fd != -1)
+                dir_size_add(sub_fd, total);
+        }
+    }
+
+    closedir(dir);
+}
+
+/* disk space used under path */
+static size_t dir_size(const char *path)
+{
+    size_t total = 0;
+    const int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1)
+        dir_size_add(fd, &total);
+    return total;
+}
+
+static int scratch_remove(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+static size_t mem_available(void)
+{
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f == NULL)
+        return 0;
+
+    size_t available = 0;
+    char line[256];
+    while (fgets(line, sizeof line, f) != NULL) {
+        unsigned long long kb = 0;
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+            available = (size_t)kb * 1024;
+            break;
+        }
+    }
+
+    fclose(f);
+    return available;
+}
+
+static size_t tmpfs_free(const slapt_src_config *config)
+{
+    struct statvfs vfs;
+    if (statvfs(config->tmpfs, &vfs) != 0)
+        return 0;
+    return (size_t)vfs.f_bavail * vfs.f_frsize;
+}
+
+static char *scratch_file(const slapt_src_config *config, const char *file)
+{
+    const size_t len = strlen(config->builddir) + strlen(file) + 2;
+    char *path = slapt_malloc(len);
+    snprintf(path, len, "%s/%s", config->builddir, file);
+    return path;
+}
+
+/* scratch space name used last time, 0 without history */
+static size_t scratch_history_get(const slapt_src_config *config, const char *name)
+{
+    char *path = scratch_file(config, SLAPT_SRC_SCRATCH_HISTORY);
+    FILE *f = fopen(path, "r");
+    free(path);
+    if (f == NULL)
+        return 0;
+
+    size_t size = 0;
+    char *line = NULL;
+    size_t line_len = 0;
+    while (getline(&line, &line_len, f) != -1) {
+        char *sep = strrchr(line, ' ');
+        if (sep != NULL && (size_t)(sep - line) == strlen(name) && strncmp(line, name, strlen(name)) == 0) {
+            size = (size_t)strtoull(sep + 1, NULL, 10);
+            break;
+        }
+    }
+    if (line != NULL)
+        free(line);
+    fclose(f);
+    return size;
+}
+
+/* rewritten under a lock, builds running in parallel all record theirs */
+static void scratch_history_set(const slapt_src_config *config, const char *name, size_t size)
+{
+    char *path = scratch_file(config, SLAPT_SRC_SCRATCH_HISTORY);
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+    if (fd == -1)
+        return;
+    FILE *f = fdopen(fd, "r+");
+    if (f == NULL) {
+        close(fd);
+        return;
+    }
+    flock(fd, LOCK_EX);
+
+    slapt_vector_t *lines = slapt_vector_t_init(free);
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t read_len;
+    while ((read_len = getline(&line, &line_len, f)) != -1) {
+        const char *sep = strrchr(line, ' ');
+        if (sep != NULL && (size_t)(sep - line) == strlen(name) && strncmp(line, name, strlen(name)) == 0)
+            continue;
+        slapt_vector_t_add(lines, strndup(line, (size_t)read_len));
+    }
+    if (line != NULL)
+        free(line);
+
+    rewind(f);
+    slapt_vector_t_foreach (const char *, kept, lines)
+        fputs(kept, f);
+    fprintf(f, "%s %zu\n", name, size);
+    fflush(f);
+    if (ftruncate(fd, ftello(f)) != 0)
+        perror("ftruncate");
+    slapt_vector_t_free(lines);
+    fclose(f);
+}
+
+/*
+ * replace our reservation with size for scratch, 0 to drop it, and return
+ * what other builds still running have reserved but not used yet.  What
+ * they already use is gone from the free space.  Callers hold the history
+ * lock.
+ */
+static size_t scratch_reserve(const slapt_src_config *config, size_t size, const char *scratch)
+{
+    char *path = scratch_file(config, SLAPT_SRC_SCRATCH_RESERVED);
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+    if (fd == -1)
+        return 0;
+    FILE *f = fdopen(fd, "r+");
+    if (f == NULL) {
+        close(fd);
+        return 0;
+    }
+
+    slapt_vector_t *lines = slapt_vector_t_init(free);
+    size_t reserved = 0;
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t read_len;
+    while ((read_len = getline(&line, &line_len, f)) != -1) {
+        long long pid = 0;
+        unsigned long long held = 0;
+        int dir_start = 0;
+        if (sscanf(line, "%lld %llu %n", &pid, &held, &dir_start) != 2 || dir_start == 0 || pid <= 0 || (pid_t)pid == getpid())
+            continue;
+        /* a build that died without dropping its reservation */
+        if (kill((pid_t)pid, 0) != 0 && errno == ESRCH)
+            continue;
+        slapt_vector_t_add(lines, strndup(line, (size_t)read_len));
+
+        line[strcspn(line, "\n")] = '\0';
+        const size_t used = dir_size(line + dir_start);
+        if ((size_t)held > used)
+            reserved += (size_t)held - used;
+    }
+    if (line != NULL)
+        free(line);
+
+    rewind(f);
+    slapt_vector_t_foreach (const char *, kept, lines)
+        fputs(kept, f);
+    if (size > 0)
+        fprintf(f, "%lld %zu %s\n", (long long)getpid(), size, scratch);
+    fflush(f);
+    if (ftruncate(fd, ftello(f)) != 0)
+        perror("ftruncate");
+    slapt_vector_t_free(lines);
+    fclose(f);
+    return reserved;
+}
+
+/* the history lock, taken for checking and reserving scratch as one step */
+static int scratch_lock(const slapt_src_config *config)
+{
+    char *path = scratch_file(config, SLAPT_SRC_SCRATCH_HISTORY);
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+    if (fd != -1)
+        flock(fd, LOCK_EX);
+    return fd;
+}
+
+/* a directory for sb's scratch on the tmpfs when expected fits, NULL to stay under BUILDDIR */
+static char *scratch_init(const slapt_src_config *config, const slapt_src_slackbuild *sb, size_t expected)
+{
+    const int lock_fd = scratch_lock(config);
+    const size_t reserved = scratch_reserve(config, 0, NULL);
+    size_t room = tmpfs_free(config), memory = mem_available() / 2;
+    room = room > reserved ? room - reserved : 0;
+    memory = memory > reserved ? memory - reserved : 0;
+    if (expected > room || expected > memory) {
+        if (lock_fd != -1)
+            close(lock_fd);
+        printf(gettext("%s needs about %zuM of scratch, building under %s\n"), sb->name, expected / (1024 * 1024) + 1, config->builddir);
+        return NULL;
+    }
+
+    const size_t len = strlen(config->tmpfs) + strlen(sb->name) + 20;
+    char *scratch = slapt_malloc(len);
+    snprintf(scratch, len, "%s/slapt-src-%s.XXXXXX", config->tmpfs, sb->name);
+    if (mkdtemp(scratch) == NULL) {
+        free(scratch);
+        scratch = NULL;
+    } else {
+        scratch_reserve(config, expected, scratch);
+    }
+
+    if (lock_fd != -1)
+        close(lock_fd);
+    return scratch;
+}
+
+static void scratch_free(const slapt_src_config *config, char *scratch)
+{
+    nftw(scratch, scratch_remove, 16, FTW_DEPTH | FTW_PHYS);
+    free(scratch);
+
+    const int lock_fd = scratch_lock(config);
+    scratch_reserve(config, 0, NULL);
+    if (lock_fd != -1)
+        close(lock_fd);
+}
+
+/* run in the slackbuild's directory, echoed only when builds are not running side by side */
+static slapt_src_command *sb_command_init(const slapt_src_config *config, const char *program, const char *location, const char *log)
+{
+    slapt_src_command *command = slapt_src_command_init(program);
+    slapt_src_command_set_cwd(command, location);
+    slapt_src_command_set_log(command, log);
+    command->echo = config->jobs <= 1;
+    return command;
+}
+
+/* everything run for sb goes into one log in its directory */
+static char *sb_log(const char *location)
+{
+    const size_t len = strlen(location) + strlen(SLAPT_SRC_BUILD_LOG) + 2;
+    char *log = slapt_malloc(len);
+    snprintf(log, len, "%s/%s", location, SLAPT_SRC_BUILD_LOG);
+    return log;
+}
+
 bool slapt_src_build_slackbuild(const slapt_src_config *config, const slapt_src_slackbuild *sb)
 {
+    slapt_src_stats_sample sample;
+    slapt_src_stats_start(&sample);
+
     if (chdir(sb->location) != 0) {
         printf(gettext("Failed to chdir to %s\n"), sb->location);
         exit(EXIT_FAILURE);
     }
 
-    /* make sure we set locations and other env vars for the slackbuilds to honor */
-    char *cwd = get_current_dir_name();
-    setenv("TMP", cwd, 1);
-    setenv("OUTPUT", cwd, 1);
-    free(cwd);
+    char *location = get_current_dir_name();
+    char *log = sb_log(location);
+    unlink(log);
+
+    /* an identical package was built before, use it instead */
+    char *cache_dir = config->pkg_cache != NULL ? pkg_cache_dir(config, sb) : NULL;
+    char *cached = cache_dir != NULL ? pkg_cache_restore(cache_dir) : NULL;
+    if (cached != NULL) {
+        printf(gettext("Using cached package %s\n"), cached);
+        free(cached);
+    } else {
+        const char *program = SLAPTSRC_CMD;
+        bool slkbuild = false;
+#if defined(HAS_SLKBUILD)
+        slapt_vector_t *slkbuild_matches = slapt_vector_t_search(sb->files, sb_compare_name_to_name, "SLKBUILD");
+        if (slkbuild_matches) {
+            program = SLAPTSRC_SLKBUILD_CMD;
+            slkbuild = true;
+            slapt_vector_t_free(slkbuild_matches);
+        }
+#endif
+        slapt_vector_t *words = slapt_parse_delimited_list(program, ' ');
+        slapt_src_command *command = sb_command_init(config, words->items[0], location, log);
+        for (uint32_t i = 1; i < words->size; i++)
+            slapt_src_command_add(command, words->items[i]);
+        slapt_vector_t_free(words);
+        if (!slkbuild) {
+            char *script = slapt_malloc(strlen(sb->name) + 12);
+            sprintf(script, "%s.SlackBuild", sb->name);
+            slapt_src_command_add(command, script);
+            free(script);
+        }
+
+        /* make sure we set locations and other env vars for the slackbuilds to honor */
+        slapt_src_command_setenv(command, "TMP", location);
+        slapt_src_command_setenv(command, "OUTPUT", location);
+        if (config->pkgext != NULL)
+            slapt_src_command_setenv(command, "PKGTYPE", config->pkgext);
+        if (config->pkgtag != NULL)
+            slapt_src_command_setenv(command, "TAG", config->pkgtag);
+        if (uses_x86_64_download(sb))
+            slapt_src_command_setenv(command, "ARCH", uname_v.machine);
+        slapt_src_command_setenv(command, "VERSION", sb->version);
+
+        char *ccache_log = config->ccache_dir != NULL ? ccache_setup(config, command, location) : NULL;
+
+        char *scratch = NULL;
+        size_t scratch_before = 0;
+        if (config->tmpfs != NULL) {
+            size_t expected = scratch_history_get(config, sb->name);
+            if (expected == 0)
+                expected = dir_size(".") * SLAPT_SRC_SCRATCH_EXPANSION;
+            if ((scratch = scratch_init(config, sb, expected)) != NULL)
+                slapt_src_command_setenv(command, "TMP", scratch);
+            else
+                scratch_before = dir_size(".");
+        }
+
+        int r = slapt_src_command_run(command);
 
-    if (config->pkgext != NULL)
-        setenv("PKGTYPE", config->pkgext, 1);
+        /* out of room on the tmpfs, remember it did not fit and go again on disk */
+        if (r != 0 && scratch != NULL && tmpfs_free(config) < SLAPT_SRC_SCRATCH_FULL) {
+            printf(gettext("%s ran out of space in %s, building again under %s\n"), sb->name, config->tmpfs, config->builddir);
+            scratch_history_set(config, sb->name, dir_size(scratch) + tmpfs_free(config) + 1);
+            scratch_free(config, scratch);
+            scratch = NULL;
 
-    if (config->pkgtag != NULL)
-        setenv("TAG", config->pkgtag, 1);
+            slapt_src_command_setenv(command, "TMP", location);
+            scratch_before = dir_size(".");
+            r = slapt_src_command_run(command);
+        }
 
-    if (strcmp(uname_v.machine, "x86_64") == 0 && sb->download_x86_64 != NULL && strcmp(sb->download_x86_64, "") != 0 && strcmp(sb->download_x86_64, "UNSUPPORTED") != 0 && strcmp(sb->download_x86_64, "UNTESTED") != 0) {
-        setenv("ARCH", uname_v.machine, 1);
-    }
+        if (r != 0) {
+            if (scratch != NULL)
+                scratch_free(config, scratch);
+            printf("%s %s\n", command->line, gettext("Failed\n"));
+            exit(EXIT_FAILURE);
+        }
 
-    char *command = NULL;
-    size_t command_len = SLAPTSRC_CMD_LEN;
-    int snprintf_r = 0;
-#if defined(HAS_SLKBUILD)
-    slapt_vector_t *slkbuild_matches = slapt_vector_t_search(sb->files, sb_compare_name_to_name, "SLKBUILD");
-    if (slkbuild_matches) {
-        command_len = SLAPTSRC_SLKBUILD_CMD_LEN;
-        command = slapt_malloc(sizeof *command * command_len);
-        snprintf_r = snprintf(command, command_len, "%s", SLAPTSRC_SLKBUILD_CMD);
-        slapt_vector_t_free(slkbuild_matches);
-    } else {
-#endif
-        command_len += strlen(sb->name);
-        command = slapt_malloc(sizeof *command * command_len);
-        snprintf_r = snprintf(command, command_len, "%s %s.SlackBuild", SLAPTSRC_CMD, sb->name);
-#if defined(HAS_SLKBUILD)
-    }
-#endif
-    if (snprintf_r <= 0 || (size_t)snprintf_r + 1 != command_len) {
-        printf("%s (%d,%zu,%s)\n", gettext("Failed to construct command string\n"), snprintf_r, command_len, command);
-        exit(EXIT_FAILURE);
-    }
+        if (config->tmpfs != NULL) {
+            if (scratch != NULL) {
+                scratch_history_set(config, sb->name, dir_size(scratch));
+                scratch_free(config, scratch);
+            } else {
+                /* leftovers of an earlier build hide some of what was used, only ever raise it */
+                const size_t after = dir_size(".");
+                const size_t used = after > scratch_before ? after - scratch_before : 0;
+                if (used > scratch_history_get(config, sb->name))
+                    scratch_history_set(config, sb->name, used);
+            }
+        }
 
-    setenv("VERSION", sb->version, 1);
-    const int r = system(command);
-    unsetenv("VERSION");
-    if (r != 0) {
-        printf("%s %s\n", command, gettext("Failed\n"));
-        exit(EXIT_FAILURE);
-    }
+        slapt_src_command_free(command);
 
-    free(command);
-    command = NULL;
+        if (ccache_log != NULL) {
+            ccache_report(sb, ccache_log);
+            free(ccache_log);
+        }
+
+        if (cache_dir != NULL) {
+            char *filename = _get_pkg_filename(sb->version, config->pkgtag);
+            if (filename != NULL) {
+                pkg_cache_store(cache_dir, filename);
+                free(filename);
+            }
+        }
+    }
+    if (cache_dir != NULL)
+        free(cache_dir);
 
     if (config->postcmd != NULL) {
         char *filename = NULL;
         if ((filename = _get_pkg_filename(sb->version, config->pkgtag)) != NULL) {
-            command_len = strlen(config->postcmd) + strlen(filename) + 2;
-            command = slapt_malloc(sizeof *command * command_len);
-            int post_snprintf_r = snprintf(command, command_len, "%s %s", config->postcmd, filename);
-            if (post_snprintf_r <= 0 || (size_t)post_snprintf_r + 1 != command_len) {
-                printf(gettext("Failed to construct command string\n"));
-                exit(EXIT_FAILURE);
-            }
-            const int post_r = system(command);
-            if (post_r != 0) {
-                printf("%s %s\n", command, gettext("Failed\n"));
+            const size_t line_len = strlen(config->postcmd) + strlen(filename) + 2;
+            char *line = slapt_malloc(line_len);
+            snprintf(line, line_len, "%s %s", config->postcmd, filename);
+
+            /* the command is the user's own, the shell still parses it */
+            slapt_src_command *command = sb_command_init(config, "sh", location, log);
+            slapt_src_command_add(command, "-c");
+            slapt_src_command_add(command, line);
+            if (slapt_src_command_run(command) != 0) {
+                printf("%s %s\n", line, gettext("Failed\n"));
                 exit(EXIT_FAILURE);
             }
-            free(command);
+            slapt_src_command_free(command);
+            free(line);
         } else {
             printf(gettext("Unable to find generated package\n"));
             exit(EXIT_FAILURE);
@@ -794,6 +3759,11 @@ bool slapt_src_build_slackbuild(const slapt_src_config *config, const slapt_src_
         free(filename);
     }
 
+    free(log);
+    free(location);
+
+    slapt_src_stats_stop(&sample, "build", sb->name);
+
     /* go back */
     if (chdir(config->builddir) != 0) {
         printf(gettext("Failed to chdir to %s\n"), config->builddir);
@@ -805,30 +3775,33 @@ bool slapt_src_build_slackbuild(const slapt_src_config *config, const slapt_src_
 
 bool slapt_src_install_slackbuild(const slapt_src_config *config, const slapt_src_slackbuild *sb)
 {
+    slapt_src_stats_sample sample;
+    slapt_src_stats_start(&sample);
+
     if (chdir(sb->location) != 0) {
         printf(gettext("Failed to chdir to %s\n"), sb->location);
         exit(EXIT_FAILURE);
     }
 
-    size_t command_len = 44;
     char *filename = _get_pkg_filename(sb->version, config->pkgtag);
     if (filename != NULL) {
-        command_len += strlen(filename);
-        char *command = slapt_malloc(sizeof *command * command_len);
-        const int snprintf_r = snprintf(command, command_len, "/sbin/upgradepkg --reinstall --install-new %s", filename);
-        if (snprintf_r <= 0 || (size_t)snprintf_r + 1 != command_len) {
-            printf(gettext("Failed to construct command string\n"));
-            exit(EXIT_FAILURE);
-        }
-
-        const int r = system(command);
-        if (r != 0) {
-            printf("%s %s\n", command, gettext("Failed\n"));
+        char *location = get_current_dir_name();
+        char *log = sb_log(location);
+        slapt_src_command *command = sb_command_init(config, "/sbin/upgradepkg", location, log);
+        slapt_src_command_add(command, "--reinstall");
+        slapt_src_command_add(command, "--install-new");
+        slapt_src_command_add(command, filename);
+
+        if (slapt_src_command_run(command) != 0) {
+            printf("%s %s\n", command->line, gettext("Failed\n"));
             exit(EXIT_FAILURE);
         }
 
+        slapt_src_command_free(command);
+        free(log);
+        free(location);
         free(filename);
-        free(command);
+        slapt_src_stats_stop(&sample, "install", sb->name);
     } else {
         printf(gettext("Unable to find generated package\n"));
         exit(EXIT_FAILURE);
@@ -842,117 +3815,237 @@ bool slapt_src_install_slackbuild(const slapt_src_config *config, const slapt_sr
     return true;
 }
 
-slapt_src_slackbuild *slapt_src_get_slackbuild(const slapt_vector_t *sbs, const char *name, const char *version)
+/* without a version the newest available is returned */
+slapt_src_slackbuild *slapt_src_get_slackbuild(const slapt_src_catalog *catalog, const char *name, const char *version)
 {
-    if (sbs->size < 1) {
+    uint32_t count = 0;
+    const uint32_t first = slapt_src_catalog_find(catalog, name, &count);
+    if (count == 0)
         return NULL;
-    }
-    int min = 0, max = (int)(sbs->size - 1);
-
-    while (max >= min) {
-        int pivot = (min + max) / 2;
-        int name_cmp = strcmp(((slapt_src_slackbuild *)sbs->items[pivot])->name, name);
 
-        if (name_cmp == 0) {
-            if (version == NULL)
-                return sbs->items[pivot];
+    if (version == NULL)
+        return catalog->slackbuilds->items[first + count - 1];
 
-            int ver_cmp = slapt_pkg_t_cmp_versions(((slapt_src_slackbuild *)sbs->items[pivot])->version, version);
-            if (ver_cmp == 0)
-                return sbs->items[pivot];
-
-            if (ver_cmp < 0)
-                min = pivot + 1;
-            else
-                max = pivot - 1;
-
-        } else {
-            if (name_cmp < 0)
-                min = pivot + 1;
-            else
-                max = pivot - 1;
-        }
+    for (uint32_t i = first; i < first + count; i++) {
+        slapt_src_slackbuild *sb = catalog->slackbuilds->items[i];
+        if (slapt_pkg_t_cmp_versions(sb->version, version) == 0)
+            return sb;
     }
 
     return NULL;
 }
 
-static bool slapt_src_resolve_dependencies(
-    const slapt_vector_t *available,
-    const slapt_src_slackbuild *sb,
-    slapt_vector_t *deps,
-    const slapt_vector_t *installed,
-    slapt_vector_t *errors)
+typedef enum {
+    SLAPT_SRC_DEP_UNVISITED,
+    SLAPT_SRC_DEP_VISITING,
+    SLAPT_SRC_DEP_RESOLVED,
+    SLAPT_SRC_DEP_MISSING,
+} slapt_src_dep_state;
+
+/* a name in the dependency graph, indexed by the catalog position of its first record */
+typedef struct _slapt_src_dep_node_ {
+    const slapt_src_slackbuild *sb;
+    const slapt_src_catalog_requires *requires; /* edges to the first record of each requirement */
+    slapt_src_dep_state state;
+    uint32_t depth;   /* place on the path while visiting */
+    uint32_t low;     /* shallowest node on the path its resolution rests on */
+    bool provisional; /* resolved through a cycle, until the node that closes it is */
+    bool emitted;
+    bool added;
+    /* first requirement found missing at or below this node */
+    const char *missing_pkg;
+    const char *missing_dep;
+} slapt_src_dep_node;
+
+typedef struct _slapt_src_dep_graph_ {
+    const slapt_src_catalog *available;
+    const slapt_src_name_index *installed;
+    slapt_src_dep_node *nodes;
+    uint32_t *path; /* the names being visited, for reporting cycles */
+    uint32_t path_len;
+    uint32_t *pending; /* provisionally resolved names, most recent last */
+    uint32_t pending_len;
+} slapt_src_dep_graph;
+
+static void dep_node_init(const slapt_src_dep_graph *graph, slapt_src_dep_node *node, uint32_t position)
 {
-    slapt_vector_t *requires = NULL;
-    if (sb->requires == NULL) {
-        return true;
-    }
+    node->sb = graph->available->slackbuilds->items[position];
+    node->requires = &graph->available->requires[position];
+}
 
-    if (strstr(sb->requires, ",") != NULL) {
-        requires = slapt_parse_delimited_list(sb->requires, ',');
-    } else {
-        requires = slapt_parse_delimited_list(sb->requires, ' ');
+/* the newest record of a name stands in for it as a dependency */
+static slapt_src_dep_node *dep_graph_node(slapt_src_dep_graph *graph, uint32_t first)
+{
+    slapt_src_dep_node *node = &graph->nodes[first];
+    if (node->sb == NULL) {
+        uint32_t count = 0;
+        slapt_src_catalog_find(graph->available, ((const slapt_src_slackbuild *)graph->available->slackbuilds->items[first])->name, &count);
+        dep_node_init(graph, node, first + count - 1);
     }
+    return node;
+}
 
-    if (requires == NULL) {
-        return true;
-    }
+static void dep_graph_report_cycle(const slapt_src_dep_graph *graph, uint32_t first)
+{
+    uint32_t from = graph->path_len;
+    while (from > 0 && graph->path[from - 1] != first)
+        from--;
+    if (from > 0)
+        from--;
+
+    fprintf(stderr, gettext("Ignoring dependency cycle:"));
+    for (uint32_t i = from; i < graph->path_len; i++)
+        fprintf(stderr, " %s ->", graph->nodes[graph->path[i]].sb->name);
+    fprintf(stderr, " %s\n", graph->nodes[first].sb->name);
+}
 
-    slapt_vector_t_foreach(const char *, dep_name, requires) {
-        slapt_src_slackbuild *sb_dep = NULL;
+static bool dep_graph_resolve(slapt_src_dep_graph *graph, uint32_t first, slapt_src_dep_node *node);
 
-        /* skip non-deps */
-        if (strcmp(dep_name, "%README%") == 0) {
+/* resolve everything node requires, each name is only ever resolved once */
+static bool dep_graph_resolve_requires(slapt_src_dep_graph *graph, slapt_src_dep_node *node)
+{
+    const slapt_src_catalog_edge *edges = &graph->available->edges[node->requires->first];
+    for (uint32_t i = 0; i < node->requires->count; i++) {
+        const char *dep_name = graph->available->edge_names + edges[i].name;
+        const uint32_t target = edges[i].target;
+
+        /* we don't have a slackbuild for it, if not installed this is an error */
+        if (target == UINT32_MAX) {
+            if (name_index_find(graph->installed, dep_name) == NULL) {
+                node->missing_pkg = node->sb->name;
+                node->missing_dep = dep_name;
+                return false;
+            }
             continue;
         }
 
-        sb_dep = slapt_src_get_slackbuild(available, dep_name, NULL);
-
         /* we will try and resolve its dependencies no matter what,
        in case there are new deps we don't yet have */
-        if (sb_dep != NULL) {
-            slapt_vector_t *matches = slapt_vector_t_search(deps, sb_compare_pkg_to_name, (char *)dep_name);
-            if (matches) {
-                slapt_vector_t_free(matches);
-                continue;
-            }
-
-            bool dep_check = slapt_src_resolve_dependencies(available, sb_dep, deps, installed, errors);
+        slapt_src_dep_node *dep = dep_graph_node(graph, target);
+        if (!dep_graph_resolve(graph, target, dep)) {
+            node->missing_pkg = dep->missing_pkg;
+            node->missing_dep = dep->missing_dep;
+            return false;
+        }
 
-            if (!dep_check) {
-                slapt_vector_t_free(requires);
-                return dep_check;
-            }
+        /* resting on a node still being visited, or on something that does */
+        if (dep->state == SLAPT_SRC_DEP_VISITING && dep->depth < node->low)
+            node->low = dep->depth;
+        else if (dep->provisional && dep->low < node->low)
+            node->low = dep->low;
+    }
+    return true;
+}
 
-            /* if not installed */
-            if (slapt_get_newest_pkg(installed, dep_name) == NULL) {
-                slapt_vector_t_add(deps, sb_dep);
-            }
-        }
-        /* we don't have a slackbuild for it */
-        else {
-            /* if not installed, this is an error */
-            if (slapt_get_newest_pkg(installed, dep_name) == NULL) {
-                slapt_vector_t_add(errors, slapt_pkg_err_t_init(strdup(sb->name), strdup((char *)dep_name)));
-                slapt_vector_t_free(requires);
-                return false;
-            }
+/*
+ * settle the names provisionally resolved since mark.  Whatever closed their
+ * cycles is resolved when missing is NULL, otherwise they depended on it and
+ * are missing too.
+ */
+static void dep_graph_settle(slapt_src_dep_graph *graph, uint32_t mark, const slapt_src_dep_node *missing)
+{
+    for (uint32_t i = mark; i < graph->pending_len; i++) {
+        slapt_src_dep_node *node = &graph->nodes[graph->pending[i]];
+        node->provisional = false;
+        if (missing != NULL) {
+            node->state = SLAPT_SRC_DEP_MISSING;
+            node->missing_pkg = missing->missing_pkg;
+            node->missing_dep = missing->missing_dep;
         }
     }
+    graph->pending_len = mark;
+}
+
+static bool dep_graph_resolve(slapt_src_dep_graph *graph, uint32_t first, slapt_src_dep_node *node)
+{
+    switch (node->state) {
+    case SLAPT_SRC_DEP_RESOLVED:
+        return true;
+    case SLAPT_SRC_DEP_MISSING:
+        return false;
+    case SLAPT_SRC_DEP_VISITING:
+        dep_graph_report_cycle(graph, first);
+        return true;
+    case SLAPT_SRC_DEP_UNVISITED:
+    default:
+        break;
+    }
 
-    slapt_vector_t_free(requires);
-    return true;
+    const uint32_t mark = graph->pending_len;
+    node->state = SLAPT_SRC_DEP_VISITING;
+    node->depth = node->low = graph->path_len;
+    graph->path[graph->path_len++] = first;
+    const bool resolved = dep_graph_resolve_requires(graph, node);
+    graph->path_len--;
+
+    if (!resolved) {
+        node->state = SLAPT_SRC_DEP_MISSING;
+        dep_graph_settle(graph, mark, node);
+    } else if (node->low < node->depth) {
+        /* it stands or falls with a node further up the path */
+        node->state = SLAPT_SRC_DEP_RESOLVED;
+        node->provisional = true;
+        graph->pending[graph->pending_len++] = first;
+    } else {
+        node->state = SLAPT_SRC_DEP_RESOLVED;
+        dep_graph_settle(graph, mark, NULL);
+    }
+    return resolved;
+}
+
+/* post order walk, so requirements always come before what requires them */
+static void dep_graph_emit(slapt_src_dep_graph *graph, const slapt_src_dep_node *node, slapt_vector_t *sbs)
+{
+    const slapt_src_catalog_edge *edges = &graph->available->edges[node->requires->first];
+    for (uint32_t i = 0; i < node->requires->count; i++) {
+        const uint32_t target = edges[i].target;
+        if (target == UINT32_MAX)
+            continue;
+
+        slapt_src_dep_node *dep = &graph->nodes[target];
+        if (dep->emitted)
+            continue;
+        dep->emitted = true;
+        dep_graph_emit(graph, dep, sbs);
+
+        /* if not installed */
+        if (!dep->added && name_index_find(graph->installed, dep->sb->name) == NULL) {
+            dep->added = true;
+            slapt_vector_t_add(sbs, (void *)dep->sb);
+        }
+    }
 }
 
 slapt_vector_t *slapt_src_names_to_slackbuilds(
     const slapt_src_config *config,
-    const slapt_vector_t *available,
+    const slapt_src_catalog *available,
     const slapt_vector_t *names,
     const slapt_vector_t *installed)
 {
     slapt_vector_t *sbs = slapt_vector_t_init(NULL);//(slapt_vector_t_free_function)slapt_src_slackbuild_free);
 
+    /* installed names are looked up once per dependency */
+    slapt_src_name_index installed_names;
+    name_index_init(&installed_names, installed->size);
+    slapt_vector_t_foreach(const slapt_pkg_t *, pkg, installed) {
+        name_index_add(&installed_names, pkg->name, 0);
+    }
+
+    /* one graph shared by every requested name */
+    slapt_src_dep_graph graph = {
+        .available = available,
+        .installed = &installed_names,
+        .nodes = calloc(available->slackbuilds->size + 1, sizeof *graph.nodes),
+        .path = calloc(available->slackbuilds->size + 1, sizeof *graph.path),
+        .path_len = 0,
+        .pending = calloc(available->slackbuilds->size + 1, sizeof *graph.pending),
+        .pending_len = 0,
+    };
+    if (graph.nodes == NULL || graph.path == NULL || graph.pending == NULL) {
+        fprintf(stderr, gettext("Failed to allocate memory\n"));
+        exit(EXIT_FAILURE);
+    }
+
     for (uint32_t i = 0; i < names->size; i++) {
         slapt_src_slackbuild *sb = NULL;
         slapt_vector_t *parts = slapt_parse_delimited_list(names->items[i], ':');
@@ -964,87 +4057,579 @@ slapt_vector_t *slapt_src_names_to_slackbuilds(
 
         slapt_vector_t_free(parts);
 
-        if (sb != NULL) {
-            if (config->do_dep == true) {
-                slapt_vector_t *deps = slapt_vector_t_init(NULL);
-                slapt_vector_t *errors = slapt_vector_t_init((slapt_vector_t_free_function)slapt_pkg_err_t_free);
-                slapt_vector_t_add(deps, sb); /* mark self as dep to prevent recursion */
-                bool dep_check = slapt_src_resolve_dependencies(available, sb, deps, installed, errors);
-
-                if (!dep_check) {
-                    slapt_vector_t_foreach(slapt_pkg_err_t *, err, errors) {
-                        fprintf(stderr, gettext("Missing slackbuild: %s requires %s\n"), err->pkg, err->error);
-                    }
-                    slapt_vector_t_free(deps);
-                    slapt_vector_t_free(errors);
-                    continue;
-                }
+        if (sb == NULL)
+            continue;
 
-                slapt_vector_t_free(errors);
+        uint32_t count = 0;
+        const uint32_t sb_first = slapt_src_catalog_find(available, sb->name, &count);
+        slapt_src_dep_node *sb_node = &graph.nodes[sb_first];
 
-                slapt_vector_t_foreach(slapt_src_slackbuild *, dep, deps) {
-                    if (strcmp(sb->name, dep->name) == 0) {
-                        continue;
-                    }
+        if (config->do_dep == true) {
+            /* an older version asked for by name gets its own requirements */
+            slapt_src_dep_node older = {0};
+            slapt_src_dep_node *root = sb_node;
+            if (sb == available->slackbuilds->items[sb_first + count - 1]) {
+                dep_graph_node(&graph, sb_first);
+            } else {
+                dep_node_init(&graph, &older, slapt_src_catalog_position(available, sb));
+                root = &older;
+            }
 
-                    slapt_vector_t *dep_matches = slapt_vector_t_search(sbs, sb_compare_pkg_to_name, dep->name);
-                    if (!dep_matches) {
-                        slapt_vector_t_add(sbs, dep);
-                    } else {
-                        slapt_vector_t_free(dep_matches);
-                    }
+            bool resolved = false;
+            if (root == sb_node) {
+                resolved = dep_graph_resolve(&graph, sb_first, sb_node);
+            } else {
+                /* requiring the newer version of itself is not a dependency */
+                const slapt_src_dep_state state = sb_node->state;
+                if (state == SLAPT_SRC_DEP_UNVISITED) {
+                    dep_graph_node(&graph, sb_first);
+                    sb_node->state = SLAPT_SRC_DEP_VISITING;
+                    sb_node->depth = graph.path_len;
                 }
-
-                slapt_vector_t_free(deps);
+                root->low = graph.path_len;
+                graph.path[graph.path_len++] = sb_first;
+                resolved = dep_graph_resolve_requires(&graph, root);
+                graph.path_len--;
+                if (state == SLAPT_SRC_DEP_UNVISITED)
+                    sb_node->state = state;
+                /* the path is empty again, nothing is left resting on it */
+                dep_graph_settle(&graph, 0, resolved ? NULL : root);
             }
 
-            slapt_vector_t *matches = slapt_vector_t_search(sbs, sb_compare_pkg_to_name, sb->name);
-            if (!matches) {
-                slapt_vector_t_add(sbs, sb);
-            } else {
-                slapt_vector_t_free(matches);
+            if (!resolved) {
+                fprintf(stderr, gettext("Missing slackbuild: %s requires %s\n"), root->missing_pkg, root->missing_dep);
+                continue;
             }
+
+            /* the requested slackbuild itself is never pulled in as its own dependency */
+            const bool emitted = sb_node->emitted;
+            sb_node->emitted = true;
+            dep_graph_emit(&graph, root, sbs);
+            sb_node->emitted = emitted || root == sb_node;
+        }
+
+        if (!sb_node->added) {
+            sb_node->added = true;
+            slapt_vector_t_add(sbs, sb);
         }
     }
 
+    free(graph.nodes);
+    free(graph.path);
+    free(graph.pending);
+    name_index_free(&installed_names);
     return sbs;
 }
 
-slapt_vector_t *slapt_src_search_slackbuild_cache(const slapt_vector_t *remote_sbs, const slapt_vector_t *names)
+static int installed_name_cmp(const void *a, const void *b)
 {
-    slapt_vector_t *sbs = slapt_vector_t_init(NULL);
+    const slapt_pkg_t *pkg1 = *(const slapt_pkg_t *const *)a;
+    const slapt_pkg_t *pkg2 = *(const slapt_pkg_t *const *)b;
+    return strcmp(pkg1->name, pkg2->name);
+}
 
-    slapt_vector_t_foreach(char *, sb_name, names) {
-        slapt_regex_t *search_regex = slapt_regex_t_init(sb_name);
-        if (search_regex == NULL) {
+/* merge join of the installed packages, sorted once here, against the name sorted catalog */
+slapt_vector_t *slapt_src_get_upgrades(const slapt_src_catalog *catalog, const slapt_vector_t *installed)
+{
+    slapt_vector_t *upgrades = slapt_vector_t_init(free);
+    if (installed->size == 0)
+        return upgrades;
+
+    const slapt_pkg_t **pkgs = slapt_malloc(sizeof *pkgs * installed->size);
+    for (uint32_t i = 0; i < installed->size; i++)
+        pkgs[i] = installed->items[i];
+    qsort(pkgs, installed->size, sizeof *pkgs, installed_name_cmp);
+
+    const slapt_vector_t *sbs = catalog->slackbuilds;
+    uint32_t i = 0, j = 0;
+    while (i < installed->size && j < sbs->size) {
+        const slapt_pkg_t *pkg = pkgs[i];
+        const slapt_src_slackbuild *sb = sbs->items[j];
+
+        const int cmp = strcmp(pkg->name, sb->name);
+        if (cmp < 0) {
+            i++;
+            continue;
+        }
+        if (cmp > 0) {
+            j++;
             continue;
         }
 
-        slapt_vector_t_foreach(slapt_src_slackbuild *, remote_sb, remote_sbs) {
-            if (strcmp(remote_sb->name, sb_name) == 0) {
-                slapt_vector_t_add(sbs, remote_sb);
-                continue;
+        /* versions of a name are adjacent and ascending, the last is the newest */
+        uint32_t newest = j;
+        while (newest + 1 < sbs->size && strcmp(((const slapt_src_slackbuild *)sbs->items[newest + 1])->name, pkg->name) == 0)
+            newest++;
+
+        const slapt_src_slackbuild *newest_sb = sbs->items[newest];
+        if (slapt_pkg_t_cmp_versions(newest_sb->version, pkg->version) == 1) {
+            slapt_src_upgrade *upgrade = slapt_malloc(sizeof *upgrade);
+            upgrade->installed = pkg;
+            upgrade->slackbuild = newest_sb;
+            slapt_vector_t_add(upgrades, upgrade);
+        }
+
+        /* the next installed package may share this name, so j stays */
+        i++;
+    }
+
+    free(pkgs);
+    return upgrades;
+}
+
+/* appends the trigrams every match of the extended regex pattern has to contain */
+static void pattern_trigrams(const char *pattern, slapt_src_u32_array *trigrams)
+{
+    char *run = slapt_malloc(strlen(pattern) + 1);
+    size_t run_len = 0;
+    uint32_t depth = 0;
+
+    for (const char *p = pattern; *p != '\0'; p++) {
+        char c = *p;
+        bool literal = false;
+        switch (c) {
+        case '|':
+            /* either side may match, so nothing outside a group is certain */
+            if (depth == 0) {
+                trigrams->size = 0;
+                free(run);
+                return;
+            }
+            break;
+        case '(':
+            /* groups may be optional or alternated, only literals outside of them count */
+            depth++;
+            break;
+        case ')':
+            if (depth > 0)
+                depth--;
+            break;
+        case '[':
+            p++;
+            if (*p == '^')
+                p++;
+            if (*p == ']')
+                p++;
+            while (*p != '\0' && *p != ']') {
+                if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+                    const char delim = p[1];
+                    p += 2;
+                    while (*p != '\0' && !(p[0] == delim && p[1] == ']'))
+                        p++;
+                    if (*p != '\0')
+                        p++;
+                }
+                if (*p != '\0')
+                    p++;
+            }
+            if (*p == '\0')
+                p--;
+            break;
+        case '*':
+        case '?':
+        case '{':
+            /* the preceding character may not be there at all */
+            if (run_len > 0)
+                run_len--;
+            while (c == '{' && p[1] != '\0' && *p != '}')
+                p++;
+            break;
+        case '\\':
+            if (p[1] != '\0' && strchr("^.[]$()|*+?{}\\", p[1]) != NULL) {
+                c = *++p;
+                literal = true;
+            } else if (p[1] != '\0') {
+                p++;
+            }
+            break;
+        case '.':
+        case '^':
+        case '$':
+        case '+':
+            break;
+        default:
+            literal = true;
+            break;
+        }
+
+        if (literal) {
+            if (depth == 0)
+                run[run_len++] = c;
+            continue;
+        }
+        add_trigrams(trigrams, run, run_len);
+        run_len = 0;
+    }
+
+    add_trigrams(trigrams, run, run_len);
+    free(run);
+}
+
+static const slapt_src_catalog_trigram *index_find(const slapt_src_catalog_index *index, uint32_t trigram)
+{
+    uint32_t lo = 0, hi = index->trigram_count;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (index->trigrams[mid].trigram < trigram)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < index->trigram_count && index->trigrams[lo].trigram == trigram)
+        return &index->trigrams[lo];
+    return NULL;
+}
+
+static int trigram_count_cmp(const void *a, const void *b)
+{
+    const slapt_src_catalog_trigram *t1 = *(const slapt_src_catalog_trigram *const *)a;
+    const slapt_src_catalog_trigram *t2 = *(const slapt_src_catalog_trigram *const *)b;
+    return (t1->count > t2->count) - (t1->count < t2->count);
+}
+
+/*
+ * fills candidates with the ascending positions of the records that can match
+ * pattern, false if the index can't narrow it down and every record has to be checked
+ */
+static bool search_candidates(const slapt_src_catalog *catalog, const char *pattern, bool case_insensitive, slapt_src_u32_array *candidates)
+{
+    const slapt_src_catalog_index *index = &catalog->index;
+    if (index->trigrams == NULL)
+        return false;
+
+    /* the index only folds ascii, REG_ICASE folds beyond it in some locales */
+    if (case_insensitive) {
+        for (const char *p = pattern; *p != '\0'; p++) {
+            if ((unsigned char)*p >= 0x80)
+                return false;
+        }
+    }
+
+    slapt_src_u32_array trigrams = {.items = NULL, .size = 0, .capacity = 0};
+    pattern_trigrams(pattern, &trigrams);
+    if (trigrams.size == 0) {
+        if (trigrams.items != NULL)
+            free(trigrams.items);
+        return false;
+    }
+
+    const slapt_src_catalog_trigram **lists = slapt_malloc(sizeof *lists * trigrams.size);
+    uint32_t list_count = 0;
+    bool narrowed = true, empty = false;
+    qsort(trigrams.items, trigrams.size, sizeof *trigrams.items, u32_cmp);
+    for (uint32_t t = 0; t < trigrams.size && narrowed && !empty; t++) {
+        if (t > 0 && trigrams.items[t] == trigrams.items[t - 1])
+            continue;
+        const slapt_src_catalog_trigram *entry = index_find(index, trigrams.items[t]);
+        if (entry == NULL)
+            empty = true;
+        else if (entry->first > index->posting_count || entry->count > index->posting_count - entry->first)
+            narrowed = false;
+        else
+            lists[list_count++] = entry;
+    }
+
+    /* intersect the posting lists, starting from the shortest */
+    candidates->size = 0;
+    if (narrowed && !empty) {
+        qsort(lists, list_count, sizeof *lists, trigram_count_cmp);
+        const uint32_t *postings = &index->postings[lists[0]->first];
+        for (uint32_t i = 0; i < lists[0]->count && narrowed; i++) {
+            if (postings[i] >= catalog->slackbuilds->size)
+                narrowed = false;
+            else
+                u32_array_add(candidates, postings[i]);
+        }
+
+        for (uint32_t l = 1; l < list_count && candidates->size > 0; l++) {
+            postings = &index->postings[lists[l]->first];
+            uint32_t kept = 0, p = 0;
+            for (uint32_t c = 0; c < candidates->size; c++) {
+                while (p < lists[l]->count && postings[p] < candidates->items[c])
+                    p++;
+                if (p < lists[l]->count && postings[p] == candidates->items[c])
+                    candidates->items[kept++] = candidates->items[c];
             }
+            candidates->size = kept;
+        }
+    }
+
+    free(lists);
+    free(trigrams.items);
+    return narrowed;
+}
+
+/* 16 bytes at a time through the GCC vector extensions, lowered to SSE2, NEON or plain words as available */
+typedef unsigned char slapt_src_v16 __attribute__((vector_size(16)));
+
+static inline slapt_src_v16 v16_load(const char *p)
+{
+    slapt_src_v16 v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline slapt_src_v16 v16_splat(unsigned char c)
+{
+    slapt_src_v16 v;
+    memset(&v, c, sizeof v);
+    return v;
+}
+
+static inline slapt_src_v16 v16_fold(slapt_src_v16 v)
+{
+    const slapt_src_v16 upper = (slapt_src_v16)((v >= v16_splat('A')) & (v <= v16_splat('Z')));
+    return v | (upper & v16_splat(0x20));
+}
+
+static inline bool v16_any(slapt_src_v16 v)
+{
+    uint64_t words[2];
+    memcpy(words, &v, sizeof words);
+    return (words[0] | words[1]) != 0;
+}
+
+static inline unsigned char ascii_fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+/* needles are short words, a byte loop beats calling out to memcmp */
+static inline bool literal_equal(const char *s, const char *needle, size_t len, bool fold)
+{
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char c = fold ? ascii_fold((unsigned char)s[i]) : (unsigned char)s[i];
+        if (c != (unsigned char)needle[i])
+            return false;
+    }
+    return true;
+}
+
+/*
+ * find needle, already folded when fold is set, in haystack.  Candidate
+ * positions are those where both the first and last byte of needle line up,
+ * checked a vector at a time before comparing the bytes in between.
+ */
+static bool literal_find(const char *haystack, size_t haystack_len, const char *needle, size_t needle_len, bool fold)
+{
+    if (needle_len == 0)
+        return true;
+    if (needle_len > haystack_len)
+        return false;
+
+    const slapt_src_v16 first = v16_splat((unsigned char)needle[0]);
+    const slapt_src_v16 last = v16_splat((unsigned char)needle[needle_len - 1]);
+    const size_t middle_len = needle_len > 2 ? needle_len - 2 : 0;
+
+    size_t i = 0;
+    for (; i + needle_len - 1 + sizeof(slapt_src_v16) <= haystack_len; i += sizeof(slapt_src_v16)) {
+        slapt_src_v16 head = v16_load(haystack + i);
+        slapt_src_v16 tail = v16_load(haystack + i + needle_len - 1);
+        if (fold) {
+            head = v16_fold(head);
+            tail = v16_fold(tail);
+        }
+        const slapt_src_v16 hits = (slapt_src_v16)(head == first) & (slapt_src_v16)(tail == last);
+        if (!v16_any(hits))
+            continue;
+        for (size_t lane = 0; lane < sizeof(slapt_src_v16); lane++) {
+            if (hits[lane] && literal_equal(haystack + i + lane + 1, needle + 1, middle_len, fold))
+                return true;
+        }
+    }
+
+    for (; i + needle_len <= haystack_len; i++) {
+        if (literal_equal(haystack + i, needle, needle_len, fold))
+            return true;
+    }
+    return false;
+}
+
+/* plain words match as substrings, the same as the regex would, without going through regexec */
+static bool pattern_is_literal(const char *pattern, bool case_insensitive)
+{
+    for (const char *p = pattern; *p != '\0'; p++) {
+        if (strchr("^.[]$()|*+?{}\\", *p) != NULL)
+            return false;
+        /* REG_ICASE folds beyond ascii in some locales */
+        if (case_insensitive && (unsigned char)*p >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+slapt_src_search_pattern *slapt_src_search_pattern_init(const char *pattern, uint32_t flags)
+{
+    slapt_src_search_pattern *search_pattern = slapt_malloc(sizeof *search_pattern);
+    search_pattern->case_insensitive = (flags & SLAPT_SRC_SEARCH_CASE_INSENSITIVE) != 0;
+    search_pattern->literal = NULL;
+    search_pattern->literal_len = 0;
+
+    if (!(flags & SLAPT_SRC_SEARCH_REGEX) && pattern_is_literal(pattern, search_pattern->case_insensitive)) {
+        search_pattern->literal_len = strlen(pattern);
+        search_pattern->literal = strdup(pattern);
+        if (search_pattern->case_insensitive) {
+            for (size_t i = 0; i < search_pattern->literal_len; i++)
+                search_pattern->literal[i] = (char)ascii_fold((unsigned char)search_pattern->literal[i]);
+        }
+        return search_pattern;
+    }
+
+    /* the same flags as slapt_regex_t, no match registers are needed */
+    int cflags = REG_EXTENDED | REG_NEWLINE | REG_NOSUB;
+    if (search_pattern->case_insensitive)
+        cflags |= REG_ICASE;
+    if (regcomp(&search_pattern->regex, pattern, cflags) != 0) {
+        free(search_pattern);
+        return NULL;
+    }
+    return search_pattern;
+}
+
+bool slapt_src_search_pattern_match(const slapt_src_search_pattern *search_pattern, const char *s)
+{
+    if (search_pattern->literal != NULL)
+        return literal_find(s, strlen(s), search_pattern->literal, search_pattern->literal_len, search_pattern->case_insensitive);
+    return regexec(&search_pattern->regex, s, 0, NULL, 0) == 0;
+}
+
+void slapt_src_search_pattern_free(slapt_src_search_pattern *search_pattern)
+{
+    if (search_pattern->literal != NULL)
+        free(search_pattern->literal);
+    else
+        regfree(&search_pattern->regex);
+    free(search_pattern);
+}
+
+static bool search_matches(const slapt_src_search_pattern *search_pattern, const slapt_src_slackbuild *remote_sb)
+{
+    if (slapt_src_search_pattern_match(search_pattern, remote_sb->name))
+        return true;
+    if (slapt_src_search_pattern_match(search_pattern, remote_sb->location))
+        return true;
+    return remote_sb->short_desc != NULL && slapt_src_search_pattern_match(search_pattern, remote_sb->short_desc);
+}
+
+/* one term run over positions, or every record when positions is NULL */
+typedef struct _slapt_src_search_scan_ {
+    const char *pattern;
+    uint32_t flags;
+    const slapt_vector_t *sbs;
+    const uint32_t *positions;
+    uint32_t total;
+    atomic_uint next;
+    bool *matches; /* per position, written by whichever thread claimed its chunk */
+} slapt_src_search_scan;
+
+static void search_scan_chunks(slapt_src_search_scan *scan, const slapt_src_search_pattern *search_pattern)
+{
+    for (;;) {
+        const uint32_t start = atomic_fetch_add(&scan->next, SLAPT_SRC_SEARCH_CHUNK);
+        if (start >= scan->total)
+            break;
+        const uint32_t end = scan->total - start > SLAPT_SRC_SEARCH_CHUNK ? start + SLAPT_SRC_SEARCH_CHUNK : scan->total;
+        for (uint32_t c = start; c < end; c++) {
+            const uint32_t position = scan->positions != NULL ? scan->positions[c] : c;
+            scan->matches[c] = search_matches(search_pattern, scan->sbs->items[position]);
+        }
+    }
+}
+
+static void *search_scan_thread(void *arg)
+{
+    slapt_src_search_scan *scan = arg;
+    /* glibc serializes regexec on a shared regex_t, so every thread compiles its own */
+    slapt_src_search_pattern *search_pattern = slapt_src_search_pattern_init(scan->pattern, scan->flags);
+    if (search_pattern != NULL) {
+        search_scan_chunks(scan, search_pattern);
+        slapt_src_search_pattern_free(search_pattern);
+    }
+    return NULL;
+}
+
+/* small scans stay on the calling thread, larger ones spread over the online cpus */
+static uint32_t search_thread_count(uint32_t total)
+{
+    uint32_t threads = total / (SLAPT_SRC_SEARCH_CHUNK * 2);
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0 && threads > (uint32_t)cpus)
+        threads = (uint32_t)cpus;
+    if (threads > SLAPT_SRC_SEARCH_MAX_THREADS)
+        threads = SLAPT_SRC_SEARCH_MAX_THREADS;
+    return threads > 0 ? threads : 1;
+}
+
+static void search_scan(slapt_src_search_scan *scan, const slapt_src_search_pattern *search_pattern)
+{
+    pthread_t threads[SLAPT_SRC_SEARCH_MAX_THREADS];
+    uint32_t started = 0;
+    const uint32_t wanted = search_thread_count(scan->total);
+
+    /* the calling thread takes chunks too, so a failed pthread_create only costs parallelism */
+    for (uint32_t t = 1; t < wanted; t++) {
+        if (pthread_create(&threads[started], NULL, search_scan_thread, scan) != 0)
+            break;
+        started++;
+    }
+    search_scan_chunks(scan, search_pattern);
+    for (uint32_t t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+}
 
-            slapt_regex_t_execute(search_regex, remote_sb->name);
-            const int name_r = search_regex->reg_return;
+slapt_vector_t *slapt_src_search_slackbuild_cache(const slapt_src_catalog *catalog, const slapt_vector_t *names, uint32_t flags)
+{
+    const slapt_vector_t *remote_sbs = catalog->slackbuilds;
+    slapt_vector_t *sbs = slapt_vector_t_init(NULL);
+    slapt_src_u32_array candidates = {.items = NULL, .size = 0, .capacity = 0};
+    bool *matches = slapt_malloc(sizeof *matches * (remote_sbs->size + 1));
 
-            slapt_regex_t_execute(search_regex, remote_sb->location);
-            const int version_r = search_regex->reg_return;
+    slapt_vector_t_foreach(char *, sb_name, names) {
+        slapt_src_search_pattern *search_pattern = slapt_src_search_pattern_init(sb_name, flags);
+        if (search_pattern == NULL) {
+            continue;
+        }
 
-            int short_desc_r = -1;
-            if (remote_sb->short_desc != NULL) {
-                slapt_regex_t_execute(search_regex, remote_sb->short_desc);
-                short_desc_r = search_regex->reg_return;
+        /* only records sharing the pattern's literal trigrams need the regex */
+        const bool narrowed = search_candidates(catalog, sb_name, search_pattern->case_insensitive, &candidates);
+        slapt_src_search_scan scan = {
+            .pattern = sb_name,
+            .flags = flags,
+            .sbs = remote_sbs,
+            .positions = narrowed ? candidates.items : NULL,
+            .total = narrowed ? candidates.size : remote_sbs->size,
+            .matches = matches,
+        };
+        atomic_init(&scan.next, 0);
+        search_scan(&scan, search_pattern);
+
+        /* an exact name match is listed whether the regex matches it or not */
+        uint32_t exact_count = 0;
+        uint32_t exact = slapt_src_catalog_find(catalog, sb_name, &exact_count);
+        const uint32_t exact_end = exact + exact_count;
+
+        /* merged back in catalog order, so the output does not depend on the threads */
+        for (uint32_t c = 0; c < scan.total; c++) {
+            const uint32_t position = narrowed ? candidates.items[c] : c;
+            for (; exact < exact_end && exact < position; exact++)
+                slapt_vector_t_add(sbs, remote_sbs->items[exact]);
+            if (exact < exact_end && exact == position) {
+                slapt_vector_t_add(sbs, remote_sbs->items[exact++]);
+                continue;
             }
 
-            if (name_r == 0 || version_r == 0 || short_desc_r == 0)
-                slapt_vector_t_add(sbs, remote_sb);
+            if (matches[c])
+                slapt_vector_t_add(sbs, remote_sbs->items[position]);
         }
+        for (; exact < exact_end; exact++)
+            slapt_vector_t_add(sbs, remote_sbs->items[exact]);
 
-        slapt_regex_t_free(search_regex);
+        slapt_src_search_pattern_free(search_pattern);
     }
 
+    free(matches);
+    if (candidates.items != NULL)
+        free(candidates.items);
     return sbs;
 }
 
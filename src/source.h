@@ -23,10 +23,26 @@
 
 #define SLAPT_SRC_RC "/etc/slapt-get/slapt-srcrc"
 #define SLAPT_SRC_DATA_FILE "slackbuilds_data"
+#define SLAPT_SRC_CATALOG_EXT ".bin"
+#define SLAPT_SRC_CATALOG_FILE SLAPT_SRC_DATA_FILE SLAPT_SRC_CATALOG_EXT
+#define SLAPT_SRC_SOURCES_FILE SLAPT_SRC_DATA_FILE ".sources"
 #define SLAPT_SRC_SOURCE_TOKEN "SOURCE="
 #define SLAPT_SRC_BUILDDIR_TOKEN "BUILDDIR="
 #define SLAPT_SRC_PKGEXT_TOKEN "PKGEXT="
 #define SLAPT_SRC_PKGTAG_TOKEN "PKGTAG="
+#define SLAPT_SRC_PREFETCH_TOKEN "PREFETCH="
+#define SLAPT_SRC_PREFETCHSIZE_TOKEN "PREFETCHSIZE="
+#define SLAPT_SRC_PREFETCH_DEFAULT 2
+#define SLAPT_SRC_PREFETCH_SIZE_DEFAULT ((size_t)1024 * 1024 * 1024)
+#define SLAPT_SRC_SOURCECACHE_TOKEN "SOURCECACHE="
+#define SLAPT_SRC_SOURCECACHESIZE_TOKEN "SOURCECACHESIZE="
+#define SLAPT_SRC_SOURCE_CACHE_SIZE_DEFAULT ((uint64_t)10 * 1024 * 1024 * 1024)
+#define SLAPT_SRC_PKGCACHE_TOKEN "PKGCACHE="
+#define SLAPT_SRC_CCACHE_TOKEN "CCACHE="
+#define SLAPT_SRC_MAKEJOBS_TOKEN "MAKEJOBS="
+#define SLAPT_SRC_MAKEJOBS_MAX 4096
+#define SLAPT_SRC_ADAPTIVE_TOKEN "ADAPTIVE="
+#define SLAPT_SRC_TMPFS_TOKEN "TMPFS="
 #define SLAPT_SRC_SOURCES_LIST_GZ "SLACKBUILDS.TXT.gz"
 #define SLAPT_SRC_SOURCES_LIST "SLACKBUILDS.TXT"
 
@@ -38,6 +54,16 @@ typedef struct _slapt_src_config_ {
     char *postcmd;
     bool do_dep;
     bool prompt;
+    uint32_t jobs;
+    uint32_t prefetch;    /* slackbuilds to fetch ahead of the one being built */
+    size_t prefetch_size; /* at most this many bytes fetched ahead */
+    char *source_cache;         /* verified sources shared between builds, NULL to disable */
+    uint64_t source_cache_size; /* evict least recently used sources beyond this */
+    char *pkg_cache;            /* packages by recipe, reused instead of building again */
+    char *ccache_dir;           /* CCACHE_DIR compilations go through, NULL to disable */
+    uint32_t make_jobs;         /* make jobs shared by every build through a jobserver, 0 to disable */
+    bool adaptive;              /* follow load and pressure below jobs and make_jobs */
+    char *tmpfs;                /* build scratch goes here when it fits, NULL for BUILDDIR */
 } slapt_src_config;
 slapt_src_config *slapt_src_config_init(void);
 void slapt_src_config_free(slapt_src_config *config);
@@ -53,22 +79,135 @@ typedef struct _slapt_src_slackbuild_ {
     char *download_x86_64;
     char *md5sum;
     char *md5sum_x86_64;
+    char *sha256sum; /* optional, for sources that publish one */
+    char *sha256sum_x86_64;
     char *short_desc;
     char *requires;
 } slapt_src_slackbuild;
 slapt_src_slackbuild *slapt_src_slackbuild_init(void);
 void slapt_src_slackbuild_free(slapt_src_slackbuild *);
 
+/* bump allocator owning parsed slackbuilds, repeated strings are interned */
+typedef struct _slapt_src_arena_chunk_ slapt_src_arena_chunk;
+typedef struct _slapt_src_arena_string_ slapt_src_arena_string;
+typedef struct _slapt_src_arena_ {
+    slapt_src_arena_chunk *chunks;
+    slapt_src_arena_string *strings;
+    uint32_t strings_count;
+    uint32_t strings_capacity;
+    /* statistics */
+    size_t chunk_count;
+    size_t bytes;
+    size_t interned;
+    size_t interned_hits;
+} slapt_src_arena;
+slapt_src_arena *slapt_src_arena_init(void);
+void slapt_src_arena_free(slapt_src_arena *);
+void *slapt_src_arena_alloc(slapt_src_arena *, size_t);
+char *slapt_src_arena_strndup(slapt_src_arena *, const char *, size_t);
+char *slapt_src_arena_intern(slapt_src_arena *, const char *, size_t);
+slapt_src_slackbuild *slapt_src_arena_slackbuild_init(slapt_src_arena *);
+
+/* name hash index, entries map a name to the first position and count of its records */
+typedef struct _slapt_src_name_index_entry_ slapt_src_name_index_entry;
+typedef struct _slapt_src_name_index_ {
+    slapt_src_name_index_entry *entries;
+    uint32_t capacity;
+    uint32_t count;
+} slapt_src_name_index;
+
+/* one REQUIRES entry of a record, resolved against the catalog it belongs to */
+typedef struct _slapt_src_catalog_edge_ {
+    uint32_t target; /* first record of the required name, UINT32_MAX if not available */
+    uint32_t name;   /* offset of the required name in edge_names */
+} slapt_src_catalog_edge;
+
+/* the REQUIRES of a record are edges[first] through edges[first + count - 1] */
+typedef struct _slapt_src_catalog_requires_ {
+    uint32_t first;
+    uint32_t count;
+    bool has_readme;
+} slapt_src_catalog_requires;
+
+/* records with trigram in their name, location or short description are postings[first] onward */
+typedef struct _slapt_src_catalog_trigram_ {
+    uint32_t trigram;
+    uint32_t first;
+    uint32_t count;
+} slapt_src_catalog_trigram;
+
+/* search index written by --update, trigrams is NULL without one */
+typedef struct _slapt_src_catalog_index_ {
+    const slapt_src_catalog_trigram *trigrams;
+    uint32_t trigram_count;
+    const uint32_t *postings;
+    uint32_t posting_count;
+} slapt_src_catalog_index;
+
+/* the loaded set of available slackbuilds, sorted by name and version */
+typedef struct _slapt_src_catalog_ {
+    slapt_vector_t *slackbuilds;
+    slapt_src_name_index names;
+    /* REQUIRES of each record, split and resolved once instead of per lookup */
+    slapt_src_catalog_requires *requires;
+    const slapt_src_catalog_edge *edges;
+    const char *edge_names;
+    slapt_src_catalog_index index;
+    /* backing storage when loaded from the binary catalog */
+    void *map;
+    size_t map_len;
+    slapt_src_slackbuild *records;
+    slapt_vector_t *record_files;
+    char **file_names;
+    /* backing storage when parsed from the text data */
+    slapt_src_arena *arena;
+} slapt_src_catalog;
+slapt_src_catalog *slapt_src_catalog_init(void);
+void slapt_src_catalog_free(slapt_src_catalog *);
+uint32_t slapt_src_catalog_find(const slapt_src_catalog *, const char *, uint32_t *);
+/* the position of sb within the catalog, UINT32_MAX if it is not one of its records */
+uint32_t slapt_src_catalog_position(const slapt_src_catalog *, const slapt_src_slackbuild *);
+
 bool slapt_src_update_slackbuild_cache(const slapt_src_config *);
-slapt_vector_t *slapt_src_get_available_slackbuilds(void);
-bool slapt_src_fetch_slackbuild(const slapt_src_config *, const slapt_src_slackbuild *);
+slapt_src_catalog *slapt_src_get_available_slackbuilds(void);
+/* downloads everything for the whole set concurrently, exits if anything fails */
+void slapt_src_fetch_slackbuilds(const slapt_src_config *, const slapt_vector_t *);
+/* fetches in a background process while the foreground builds sbs in order */
+typedef struct _slapt_src_prefetch_ slapt_src_prefetch;
+slapt_src_prefetch *slapt_src_prefetch_start(const slapt_src_config *, const slapt_vector_t *);
+/* blocks until sbs[index] is fetched, false if that failed */
+bool slapt_src_prefetch_wait(slapt_src_prefetch *, uint32_t);
+void slapt_src_prefetch_free(slapt_src_prefetch *);
+/* false if the user declined to continue after reading it, sb is a record of catalog */
+bool slapt_src_show_slackbuild_readme(const slapt_src_config *, const slapt_src_catalog *, const slapt_src_slackbuild *);
 bool slapt_src_build_slackbuild(const slapt_src_config *, const slapt_src_slackbuild *);
 bool slapt_src_install_slackbuild(const slapt_src_config *, const slapt_src_slackbuild *);
-slapt_vector_t *slapt_src_names_to_slackbuilds(const slapt_src_config *, const slapt_vector_t *, const slapt_vector_t *, const slapt_vector_t *);
-slapt_vector_t *slapt_src_get_slackbuilds_from_file(const char *);
+slapt_vector_t *slapt_src_names_to_slackbuilds(const slapt_src_config *, const slapt_src_catalog *, const slapt_vector_t *, const slapt_vector_t *);
+slapt_vector_t *slapt_src_get_slackbuilds_from_file(const char *, slapt_src_arena *);
 void slapt_src_write_slackbuilds_to_file(slapt_vector_t *, const char *);
-slapt_vector_t *slapt_src_search_slackbuild_cache(const slapt_vector_t *, const slapt_vector_t *);
-slapt_src_slackbuild *slapt_src_get_slackbuild(const slapt_vector_t *, const char *, const char *);
+/* an installed package and the newest available slackbuild that upgrades it */
+typedef struct _slapt_src_upgrade_ {
+    const slapt_pkg_t *installed;
+    const slapt_src_slackbuild *slackbuild;
+} slapt_src_upgrade;
+slapt_vector_t *slapt_src_get_upgrades(const slapt_src_catalog *, const slapt_vector_t *);
+
+#define SLAPT_SRC_SEARCH_CASE_INSENSITIVE 0x1u
+#define SLAPT_SRC_SEARCH_REGEX 0x2u /* never take the plain word fast path */
+
+/* a compiled search term, plain words are matched as substrings instead of through regexec */
+typedef struct _slapt_src_search_pattern_ {
+    char *literal; /* NULL when regex is used */
+    size_t literal_len;
+    bool case_insensitive;
+    regex_t regex;
+} slapt_src_search_pattern;
+slapt_src_search_pattern *slapt_src_search_pattern_init(const char *, uint32_t);
+bool slapt_src_search_pattern_match(const slapt_src_search_pattern *, const char *);
+void slapt_src_search_pattern_free(slapt_src_search_pattern *);
+
+slapt_vector_t *slapt_src_search_slackbuild_cache(const slapt_src_catalog *, const slapt_vector_t *, uint32_t);
+slapt_src_slackbuild *slapt_src_get_slackbuild(const slapt_src_catalog *, const char *, const char *);
 
 int sb_compare_name_to_name(const void *a, const void *b);
 int sb_compare_pkg_to_name(const void *a, const void *b);
@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sys/resource.h>
+#include "stats.h"
+#include "config.h"
+
+/* one line per record: phase, name, measured, wall, cpu, downloaded, read, written, peak rss */
+#define SLAPT_SRC_STATS_LINE_MAX 1024
+
+static int stats_fd = -1;
+static pid_t stats_pid = 0;
+static bool stats_json = false;
+static uint64_t stats_downloaded = 0;
+static slapt_src_stats_sample stats_total;
+
+typedef struct _slapt_src_stats_record_ {
+    char *phase;
+    char *name; /* NULL for none */
+    uint32_t count;
+    bool measured; /* false for transfers, which only have wall time and bytes */
+    double wall;
+    double cpu;
+    uint64_t downloaded;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t peak_rss;
+} slapt_src_stats_record;
+
+static void stats_record_free(void *data)
+{
+    slapt_src_stats_record *record = data;
+    free(record->phase);
+    if (record->name != NULL)
+        free(record->name);
+    free(record);
+}
+
+static void stats_report(void);
+
+void slapt_src_stats_init(bool json)
+{
+    FILE *f = tmpfile();
+    if (f == NULL) {
+        perror("tmpfile");
+        exit(EXIT_FAILURE);
+    }
+
+    /* forked children share it, appending whole lines, the builds they run do not */
+    stats_fd = dup(fileno(f));
+    fclose(f);
+    if (stats_fd == -1 || fcntl(stats_fd, F_SETFL, O_APPEND) == -1 || fcntl(stats_fd, F_SETFD, FD_CLOEXEC) == -1) {
+        perror("fcntl");
+        exit(EXIT_FAILURE);
+    }
+
+    stats_pid = getpid();
+    stats_json = json;
+    slapt_src_stats_start(&stats_total);
+    atexit(stats_report);
+}
+
+static void proc_self_io(uint64_t *read_bytes, uint64_t *write_bytes)
+{
+    *read_bytes = 0;
+    *write_bytes = 0;
+
+    FILE *f = fopen("/proc/self/io", "r");
+    if (f == NULL)
+        return;
+
+    char line[128];
+    unsigned long long value = 0;
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (sscanf(line, "read_bytes: %llu", &value) == 1)
+            *read_bytes = value;
+        else if (sscanf(line, "write_bytes: %llu", &value) == 1)
+            *write_bytes = value;
+    }
+    fclose(f);
+}
+
+static double timeval_seconds(const struct timeval *tv)
+{
+    return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+void slapt_src_stats_start(slapt_src_stats_sample *sample)
+{
+    if (stats_fd == -1)
+        return;
+
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    clock_gettime(CLOCK_MONOTONIC, &sample->wall);
+    sample->cpu = timeval_seconds(&self.ru_utime) + timeval_seconds(&self.ru_stime) + timeval_seconds(&children.ru_utime) + timeval_seconds(&children.ru_stime);
+    sample->downloaded = stats_downloaded;
+    proc_self_io(&sample->read_bytes, &sample->write_bytes);
+    sample->children_maxrss = children.ru_maxrss;
+}
+
+/* names come from the catalog and urls, keep the line format intact regardless */
+static void stats_write(const char *phase, const char *name, bool measured, double wall, double cpu, uint64_t downloaded, uint64_t read_bytes, uint64_t write_bytes, uint64_t peak_rss)
+{
+    char clean[SLAPT_SRC_STATS_LINE_MAX / 2];
+    snprintf(clean, sizeof clean, "%s", name != NULL && name[0] != '\0' ? name : "-");
+    for (char *c = clean; *c != '\0'; c++) {
+        if (*c == '\t' || *c == '\n' || *c == '\r')
+            *c = ' ';
+    }
+
+    char line[SLAPT_SRC_STATS_LINE_MAX];
+    const int len = snprintf(line, sizeof line, "%s\t%s\t%d\t%.6f\t%.6f\t%llu\t%llu\t%llu\t%llu\n", phase, clean, measured, wall, cpu,
+                             (unsigned long long)downloaded, (unsigned long long)read_bytes, (unsigned long long)write_bytes, (unsigned long long)peak_rss);
+    if (len <= 0 || (size_t)len >= sizeof line)
+        return;
+
+    /* a single append, so lines from concurrent processes never interleave */
+    if (write(stats_fd, line, (size_t)len) != len)
+        perror("write");
+}
+
+void slapt_src_stats_stop(const slapt_src_stats_sample *sample, const char *phase, const char *name)
+{
+    if (stats_fd == -1)
+        return;
+
+    slapt_src_stats_sample now;
+    slapt_src_stats_start(&now);
+
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+
+    /* a bigger child than any before was reaped during the phase */
+    long peak = self.ru_maxrss;
+    if (now.children_maxrss > sample->children_maxrss && now.children_maxrss > peak)
+        peak = now.children_maxrss;
+
+    const double wall = (double)(now.wall.tv_sec - sample->wall.tv_sec) + (double)(now.wall.tv_nsec - sample->wall.tv_nsec) / 1e9;
+    stats_write(phase, name, true, wall, now.cpu - sample->cpu, now.downloaded - sample->downloaded,
+                now.read_bytes > sample->read_bytes ? now.read_bytes - sample->read_bytes : 0,
+                now.write_bytes > sample->write_bytes ? now.write_bytes - sample->write_bytes : 0,
+                (uint64_t)peak * 1024);
+}
+
+void slapt_src_stats_transfer(const char *name, double seconds, uint64_t bytes)
+{
+    if (stats_fd == -1)
+        return;
+    stats_write("download", name, false, seconds, 0, bytes, 0, 0, 0);
+}
+
+void slapt_src_stats_downloaded(uint64_t bytes)
+{
+    stats_downloaded += bytes;
+}
+
+static slapt_src_stats_record *stats_parse(char *line)
+{
+    char *fields[9];
+    char *save = NULL, *s = line;
+    for (uint32_t i = 0; i < 9; i++) {
+        if ((fields[i] = strtok_r(s, "\t\n", &save)) == NULL)
+            return NULL;
+        s = NULL;
+    }
+
+    slapt_src_stats_record *record = slapt_malloc(sizeof *record);
+    record->phase = strdup(fields[0]);
+    record->name = strcmp(fields[1], "-") != 0 ? strdup(fields[1]) : NULL;
+    record->count = 1;
+    record->measured = strcmp(fields[2], "1") == 0;
+    record->wall = strtod(fields[3], NULL);
+    record->cpu = strtod(fields[4], NULL);
+    record->downloaded = strtoull(fields[5], NULL, 10);
+    record->read_bytes = strtoull(fields[6], NULL, 10);
+    record->write_bytes = strtoull(fields[7], NULL, 10);
+    record->peak_rss = strtoull(fields[8], NULL, 10);
+    return record;
+}
+
+/* phases in the order they were first seen, with the records of each added up */
+static slapt_vector_t *stats_phases(const slapt_vector_t *records)
+{
+    slapt_vector_t *phases = slapt_vector_t_init(stats_record_free);
+    slapt_vector_t_foreach (const slapt_src_stats_record *, record, records) {
+        slapt_src_stats_record *phase = NULL;
+        slapt_vector_t_foreach (slapt_src_stats_record *, p, phases) {
+            if (strcmp(p->phase, record->phase) == 0) {
+                phase = p;
+                break;
+            }
+        }
+        if (phase == NULL) {
+            phase = slapt_malloc(sizeof *phase);
+            *phase = *record;
+            phase->phase = strdup(record->phase);
+            phase->name = NULL;
+            slapt_vector_t_add(phases, phase);
+            continue;
+        }
+
+        phase->count++;
+        phase->measured = phase->measured || record->measured;
+        phase->wall += record->wall;
+        phase->cpu += record->cpu;
+        phase->downloaded += record->downloaded;
+        phase->read_bytes += record->read_bytes;
+        phase->write_bytes += record->write_bytes;
+        if (record->peak_rss > phase->peak_rss)
+            phase->peak_rss = record->peak_rss;
+    }
+    return phases;
+}
+
+static const char *format_size(uint64_t bytes, char *buffer, size_t len)
+{
+    const char *units = "BKMGT";
+    double size = (double)bytes;
+    while (size >= 1024 && units[1] != '\0') {
+        size /= 1024;
+        units++;
+    }
+    if (units[0] == 'B')
+        snprintf(buffer, len, "%lluB", (unsigned long long)bytes);
+    else
+        snprintf(buffer, len, "%.1f%c", size, units[0]);
+    return buffer;
+}
+
+static void stats_print_row(const char *label, const slapt_src_stats_record *record)
+{
+    char downloaded[16], read_bytes[16], write_bytes[16], peak_rss[16];
+    format_size(record->downloaded, downloaded, sizeof downloaded);
+    if (!record->measured) {
+        fprintf(stderr, "  %-24s %5u %9.2fs %10s %10s %9s %9s %9s\n", label, record->count, record->wall, "-", downloaded, "-", "-", "-");
+        return;
+    }
+    fprintf(stderr, "  %-24s %5u %9.2fs %9.2fs %10s %9s %9s %9s\n", label, record->count, record->wall, record->cpu, downloaded,
+            format_size(record->read_bytes, read_bytes, sizeof read_bytes), format_size(record->write_bytes, write_bytes, sizeof write_bytes),
+            format_size(record->peak_rss, peak_rss, sizeof peak_rss));
+}
+
+static void stats_print_text(const slapt_vector_t *phases, const slapt_vector_t *records)
+{
+    fprintf(stderr, "\n%s\n", gettext("Statistics:"));
+    fprintf(stderr, "  %-24s %5s %10s %10s %10s %9s %9s %9s\n", gettext("phase"), gettext("count"), gettext("wall"), gettext("cpu"),
+            gettext("downloaded"), gettext("read"), gettext("written"), gettext("peak rss"));
+    slapt_vector_t_foreach (const slapt_src_stats_record *, phase, phases)
+        stats_print_row(phase->phase, phase);
+
+    /* downloads are per file, there can be many, their total is enough here */
+    bool header = false;
+    slapt_vector_t_foreach (const slapt_src_stats_record *, record, records) {
+        if (record->name == NULL || !record->measured)
+            continue;
+        if (!header) {
+            fprintf(stderr, "  %s\n", gettext("per slackbuild:"));
+            header = true;
+        }
+        char label[64];
+        snprintf(label, sizeof label, "%s %s", record->name, record->phase);
+        stats_print_row(label, record);
+    }
+}
+
+static void json_string(const char *s)
+{
+    fputc('"', stderr);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(stderr, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(stderr, "\\u%04x", (unsigned int)(unsigned char)*s);
+        else
+            fputc(*s, stderr);
+    }
+    fputc('"', stderr);
+}
+
+static void json_record(const slapt_src_stats_record *record, bool with_name)
+{
+    fprintf(stderr, "{\"phase\":");
+    json_string(record->phase);
+    if (with_name) {
+        fprintf(stderr, ",\"name\":");
+        if (record->name != NULL)
+            json_string(record->name);
+        else
+            fprintf(stderr, "null");
+    } else {
+        fprintf(stderr, ",\"count\":%u", record->count);
+    }
+    fprintf(stderr, ",\"wall_seconds\":%.6f,\"downloaded_bytes\":%llu", record->wall, (unsigned long long)record->downloaded);
+    if (record->measured)
+        fprintf(stderr, ",\"cpu_seconds\":%.6f,\"read_bytes\":%llu,\"write_bytes\":%llu,\"peak_rss_bytes\":%llu", record->cpu,
+                (unsigned long long)record->read_bytes, (unsigned long long)record->write_bytes, (unsigned long long)record->peak_rss);
+    fputc('}', stderr);
+}
+
+static void stats_print_json(const slapt_vector_t *phases, const slapt_vector_t *records)
+{
+    fprintf(stderr, "{\"phases\":[");
+    for (uint32_t i = 0; i < phases->size; i++) {
+        if (i > 0)
+            fputc(',', stderr);
+        json_record(phases->items[i], false);
+    }
+    fprintf(stderr, "],\"records\":[");
+    for (uint32_t i = 0; i < records->size; i++) {
+        if (i > 0)
+            fputc(',', stderr);
+        json_record(records->items[i], true);
+    }
+    fprintf(stderr, "]}\n");
+}
+
+/* atexit, in slapt-src itself only */
+static void stats_report(void)
+{
+    if (stats_fd == -1 || getpid() != stats_pid)
+        return;
+
+    slapt_src_stats_stop(&stats_total, "total", NULL);
+
+    slapt_vector_t *records = slapt_vector_t_init(stats_record_free);
+    FILE *f = NULL;
+    if (lseek(stats_fd, 0, SEEK_SET) == 0 && (f = fdopen(stats_fd, "r")) != NULL) {
+        char *line = NULL;
+        size_t len = 0;
+        while (getline(&line, &len, f) != -1) {
+            slapt_src_stats_record *record = stats_parse(line);
+            if (record != NULL)
+                slapt_vector_t_add(records, record);
+        }
+        if (line != NULL)
+            free(line);
+        fclose(f);
+    } else {
+        close(stats_fd);
+    }
+    stats_fd = -1;
+
+    /* downloads made by forked processes never reached this one's counter */
+    uint64_t downloaded = 0;
+    slapt_src_stats_record *total = NULL;
+    slapt_vector_t_foreach (slapt_src_stats_record *, record, records) {
+        if (!record->measured)
+            downloaded += record->downloaded;
+        else if (strcmp(record->phase, "total") == 0)
+            total = record;
+    }
+    if (total != NULL && downloaded > total->downloaded)
+        total->downloaded = downloaded;
+
+    slapt_vector_t *phases = stats_phases(records);
+    if (stats_json)
+        stats_print_json(phases, records);
+    else
+        stats_print_text(phases, records);
+    slapt_vector_t_free(phases);
+    slapt_vector_t_free(records);
+}
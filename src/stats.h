@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <slapt.h>
+#include <time.h>
+#ifndef __SLAPT_SRC_STATS_H__
+#define __SLAPT_SRC_STATS_H__
+
+/*
+ * --stats: wall and cpu time, bytes downloaded, bytes read and written per
+ * /proc/self/io and peak resident size, recorded per phase and per
+ * slackbuild.  Records are appended to a file shared with every process
+ * forked from here, so builds in scheduler workers and downloads in the
+ * prefetcher are counted too, and slapt-src itself reports them all to
+ * stderr when it exits.  Forked children leave with _exit, or are ignored
+ * if they do not.  Every call does nothing until slapt_src_stats_init.
+ */
+typedef struct _slapt_src_stats_sample_ {
+    struct timespec wall;
+    double cpu; /* user and system seconds, of this process and its waited for children */
+    uint64_t downloaded;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    long children_maxrss;
+} slapt_src_stats_sample;
+
+/* json selects the JSON report over the table */
+void slapt_src_stats_init(bool json);
+
+/* time a phase, name is the slackbuild or file it was for, NULL for none */
+void slapt_src_stats_start(slapt_src_stats_sample *sample);
+void slapt_src_stats_stop(const slapt_src_stats_sample *sample, const char *phase, const char *name);
+
+/* a transfer, timed by curl rather than sampled since they overlap */
+void slapt_src_stats_transfer(const char *name, double seconds, uint64_t bytes);
+/* counted against every phase running in this process */
+void slapt_src_stats_downloaded(uint64_t bytes);
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#define _GNU_SOURCE
+#include "stats.h"
+#include "transfer.h"
+#include "config.h"
+
+struct _slapt_src_transfer_pool_ {
+    CURLM *multi;
+    slapt_vector_t *queue;
+    uint32_t queue_start;
+    uint32_t running;
+    uint32_t max_transfers;
+};
+
+slapt_src_transfer *slapt_src_transfer_init(const char *url, const char *filename, slapt_src_transfer_done_function done, void *data)
+{
+    slapt_src_transfer *transfer = slapt_malloc(sizeof *transfer);
+    transfer->url = strdup(url);
+    transfer->filename = filename != NULL ? strdup(filename) : NULL;
+    transfer->resume = false;
+    transfer->fh = NULL;
+    transfer->resume_from = 0;
+    transfer->head = NULL;
+    transfer->ok = false;
+    transfer->result = CURLE_OK;
+    transfer->response_code = 0;
+    transfer->error[0] = '\0';
+    transfer->seconds = 0;
+    transfer->downloaded = 0;
+    transfer->done = done;
+    transfer->size = NULL;
+    transfer->write = NULL;
+    transfer->data = data;
+    transfer->handle = NULL;
+    return transfer;
+}
+
+void slapt_src_transfer_free(slapt_src_transfer *transfer)
+{
+    if (transfer->handle != NULL)
+        curl_easy_cleanup(transfer->handle);
+    if (transfer->fh != NULL)
+        fclose(transfer->fh);
+    if (transfer->filename != NULL)
+        free(transfer->filename);
+    if (transfer->head != NULL)
+        free(transfer->head);
+    free(transfer->url);
+    free(transfer);
+}
+
+slapt_src_transfer_pool *slapt_src_transfer_pool_init(uint32_t max_transfers, uint32_t max_host_transfers)
+{
+    slapt_src_transfer_pool *pool = slapt_malloc(sizeof *pool);
+    pool->multi = curl_multi_init();
+    if (pool->multi == NULL) {
+        fprintf(stderr, gettext("Failed to initialize curl\n"));
+        exit(EXIT_FAILURE);
+    }
+    /* anything over the per host limit waits inside curl for a free connection */
+    curl_multi_setopt(pool->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_host_transfers);
+    pool->queue = slapt_vector_t_init(NULL);
+    pool->queue_start = 0;
+    pool->running = 0;
+    pool->max_transfers = max_transfers > 0 ? max_transfers : 1;
+    return pool;
+}
+
+void slapt_src_transfer_pool_free(slapt_src_transfer_pool *pool)
+{
+    for (uint32_t i = pool->queue_start; i < pool->queue->size; i++)
+        slapt_src_transfer_free(pool->queue->items[i]);
+    slapt_vector_t_free(pool->queue);
+    curl_multi_cleanup(pool->multi);
+    free(pool);
+}
+
+void slapt_src_transfer_pool_add(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer)
+{
+    slapt_vector_t_add(pool->queue, transfer);
+}
+
+/* keep the header line the head cache is keyed on */
+static size_t head_header(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    slapt_src_transfer *transfer = userdata;
+    const size_t len = size * nitems;
+
+    const bool last_modified = len > 14 && strncasecmp(buffer, "Last-Modified:", 14) == 0;
+    const bool content_length = len > 15 && strncasecmp(buffer, "Content-Length:", 15) == 0;
+    if (last_modified || (content_length && (transfer->head == NULL || strncasecmp(transfer->head, "Content-Length:", 15) == 0))) {
+        size_t line_len = len;
+        while (line_len > 0 && (buffer[line_len - 1] == '\n' || buffer[line_len - 1] == '\r'))
+            line_len--;
+        if (transfer->head != NULL)
+            free(transfer->head);
+        transfer->head = strndup(buffer, line_len);
+    }
+
+    return len;
+}
+
+/* the headers of a successful response end, a partial one adds what is already there */
+static size_t download_header(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    slapt_src_transfer *transfer = userdata;
+    const size_t len = size * nitems;
+    if (len > 2 || (buffer[0] != '\r' && buffer[0] != '\n'))
+        return len;
+
+    long response_code = 0;
+    curl_off_t length = -1;
+    curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code < 200 || response_code > 299)
+        return len;
+    if (curl_easy_getinfo(transfer->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK && length >= 0)
+        transfer->size(transfer, (uint64_t)length + (response_code == 206 ? transfer->resume_from : 0));
+    return len;
+}
+
+static size_t write_body(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    slapt_src_transfer *transfer = userdata;
+    const size_t written = fwrite(buffer, size, nitems, transfer->fh);
+    if (written != nitems)
+        return 0;
+    if (transfer->write != NULL)
+        transfer->write(transfer, buffer, size * nitems);
+    return size * nitems;
+}
+
+static void start_transfer(slapt_src_transfer_pool *pool, slapt_src_transfer *transfer)
+{
+    CURL *handle = curl_easy_init();
+    if (handle == NULL) {
+        fprintf(stderr, gettext("Failed to initialize curl\n"));
+        exit(EXIT_FAILURE);
+    }
+
+    curl_easy_setopt(handle, CURLOPT_URL, transfer->url);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, transfer);
+    curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, transfer->error);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, PACKAGE "/" VERSION);
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+
+    if (transfer->filename == NULL) {
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, head_header);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, transfer);
+    } else {
+        /* opened only now so a long queue does not hold a descriptor per file */
+        transfer->fh = slapt_open_file(transfer->filename, transfer->resume ? "a+b" : "w+b");
+        if (transfer->fh == NULL) {
+            exit(EXIT_FAILURE);
+        }
+        if (transfer->resume && fseeko(transfer->fh, 0, SEEK_END) == 0)
+            transfer->resume_from = (size_t)ftello(transfer->fh);
+
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_body);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, transfer);
+        if (transfer->resume_from > 0)
+            curl_easy_setopt(handle, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)transfer->resume_from);
+        if (transfer->size != NULL) {
+            curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, download_header);
+            curl_easy_setopt(handle, CURLOPT_HEADERDATA, transfer);
+        }
+    }
+
+    transfer->handle = handle;
+    curl_multi_add_handle(pool->multi, handle);
+    pool->running++;
+}
+
+/* the number of transfers that finished */
+static uint32_t finish_transfers(slapt_src_transfer_pool *pool)
+{
+    uint32_t finished = 0;
+    CURLMsg *msg = NULL;
+    int left = 0;
+    while ((msg = curl_multi_info_read(pool->multi, &left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        slapt_src_transfer *transfer = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&transfer);
+        transfer->result = msg->data.result;
+        transfer->ok = transfer->result == CURLE_OK;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &transfer->response_code);
+        curl_off_t total_time = 0, size_download = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_TOTAL_TIME_T, &total_time);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_SIZE_DOWNLOAD_T, &size_download);
+        transfer->seconds = (double)total_time / 1e6;
+        transfer->downloaded = (uint64_t)size_download;
+        slapt_src_stats_downloaded(transfer->downloaded);
+        if (transfer->fh != NULL)
+            fflush(transfer->fh);
+        if (!transfer->ok && transfer->error[0] == '\0')
+            snprintf(transfer->error, sizeof transfer->error, "%s", curl_easy_strerror(msg->data.result));
+
+        curl_multi_remove_handle(pool->multi, msg->easy_handle);
+        curl_easy_cleanup(transfer->handle);
+        transfer->handle = NULL;
+        pool->running--;
+
+        transfer->done(pool, transfer);
+        slapt_src_transfer_free(transfer);
+        finished++;
+    }
+    return finished;
+}
+
+bool slapt_src_transfer_pool_step(slapt_src_transfer_pool *pool, struct curl_waitfd *extra_fds, unsigned int extra_nfds)
+{
+    while (pool->running < pool->max_transfers && pool->queue_start < pool->queue->size) {
+        slapt_src_transfer *transfer = pool->queue->items[pool->queue_start];
+        pool->queue->items[pool->queue_start++] = NULL;
+        start_transfer(pool, transfer);
+    }
+
+    uint32_t finished = 0;
+    if (pool->running > 0) {
+        int still_running = 0;
+        const CURLMcode rc = curl_multi_perform(pool->multi, &still_running);
+        if (rc != CURLM_OK) {
+            fprintf(stderr, "%s\n", curl_multi_strerror(rc));
+            exit(EXIT_FAILURE);
+        }
+
+        finished = finish_transfers(pool);
+    }
+
+    /* callbacks may have queued more, start those right away instead of waiting.
+       the caller may queue more once something finished, so that does not wait either */
+    const bool queued = pool->queue_start < pool->queue->size;
+    if (!queued && finished == 0 && (pool->running > 0 || extra_nfds > 0))
+        curl_multi_poll(pool->multi, extra_fds, extra_nfds, 1000, NULL);
+
+    if (pool->running == 0 && !queued) {
+        /* everything queued has been started and finished */
+        slapt_vector_t_free(pool->queue);
+        pool->queue = slapt_vector_t_init(NULL);
+        pool->queue_start = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void slapt_src_transfer_pool_run(slapt_src_transfer_pool *pool)
+{
+    while (slapt_src_transfer_pool_step(pool, NULL, 0))
+        ;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <slapt.h>
+#ifndef __SLAPT_SRC_TRANSFER_H__
+#define __SLAPT_SRC_TRANSFER_H__
+
+#define SLAPT_SRC_MAX_TRANSFERS 8
+#define SLAPT_SRC_MAX_HOST_TRANSFERS 4
+
+typedef struct _slapt_src_transfer_pool_ slapt_src_transfer_pool;
+typedef struct _slapt_src_transfer_ slapt_src_transfer;
+
+/* called once a transfer finishes, more transfers may be added to the pool from here */
+typedef void (*slapt_src_transfer_done_function)(slapt_src_transfer_pool *, slapt_src_transfer *);
+/* called once the response headers give the size of the whole file */
+typedef void (*slapt_src_transfer_size_function)(slapt_src_transfer *, uint64_t);
+/* sees each chunk of the body as it is written to filename */
+typedef void (*slapt_src_transfer_write_function)(slapt_src_transfer *, const char *, size_t);
+
+struct _slapt_src_transfer_ {
+    char *url;
+    char *filename; /* NULL for a HEAD request */
+    bool resume;    /* append to an existing filename instead of truncating it */
+    FILE *fh;       /* opened when the transfer starts, closed after done */
+    size_t resume_from;
+    char *head; /* Last-Modified, or Content-Length, header line of a HEAD request */
+    bool ok;
+    CURLcode result;
+    long response_code;
+    char error[CURL_ERROR_SIZE];
+    double seconds;      /* from start to finish, queueing aside */
+    uint64_t downloaded; /* body bytes received */
+    slapt_src_transfer_done_function done;
+    slapt_src_transfer_size_function size; /* optional */
+    slapt_src_transfer_write_function write; /* optional */
+    void *data;
+    CURL *handle;
+};
+slapt_src_transfer *slapt_src_transfer_init(const char *url, const char *filename, slapt_src_transfer_done_function done, void *data);
+void slapt_src_transfer_free(slapt_src_transfer *);
+
+/* runs queued transfers concurrently, at most max_transfers at a time and max_host_transfers per host */
+slapt_src_transfer_pool *slapt_src_transfer_pool_init(uint32_t max_transfers, uint32_t max_host_transfers);
+void slapt_src_transfer_pool_free(slapt_src_transfer_pool *);
+void slapt_src_transfer_pool_add(slapt_src_transfer_pool *, slapt_src_transfer *);
+void slapt_src_transfer_pool_run(slapt_src_transfer_pool *);
+/* one round of transfers, waiting up to a second on them or extra_fds, false once nothing is left */
+bool slapt_src_transfer_pool_step(slapt_src_transfer_pool *, struct curl_waitfd *extra_fds, unsigned int extra_nfds);
+
+#endif
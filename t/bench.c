@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2010-2025 Jason Woodward <woodwardj at jaos dot org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * catalog benchmarks, run with `meson test --benchmark -C build`
+ * SLAPT_SRC_BENCH_DATA must point at a SLACKBUILDS.TXT from a full SBo tree
+ * `meson test` runs search against t/slackbuilds to check the index against a full scan
+ */
+
+#define _GNU_SOURCE
+#include <locale.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "source.h"
+#include "config.h"
+
+#define BENCH_SKIP 77
+#define BENCH_MIN_SECONDS 1.0
+
+struct utsname uname_v;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* write datafile out as slackbuilds_data and its binary catalog in a new tmpdir, and change into it */
+static bool catalog_create(const char *datafile, char *tmpdir)
+{
+    if (mkdtemp(tmpdir) == NULL || chdir(tmpdir) != 0) {
+        perror(tmpdir);
+        return false;
+    }
+
+    slapt_src_arena *arena = slapt_src_arena_init();
+    slapt_vector_t *sbs = slapt_src_get_slackbuilds_from_file(datafile, arena);
+    slapt_src_write_slackbuilds_to_file(sbs, SLAPT_SRC_DATA_FILE);
+    slapt_vector_t_free(sbs);
+    slapt_src_arena_free(arena);
+    return true;
+}
+
+static void catalog_remove(const char *tmpdir)
+{
+    unlink(SLAPT_SRC_DATA_FILE);
+    unlink(SLAPT_SRC_CATALOG_FILE);
+    if (chdir("/") == 0)
+        rmdir(tmpdir);
+}
+
+static int bench_parse(const char *datafile)
+{
+    struct stat st;
+    if (stat(datafile, &st) != 0) {
+        perror(datafile);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t count = 0;
+    int iterations = 0;
+    const double start = now();
+    double elapsed = 0;
+    slapt_src_arena arena_stats = {0};
+    do {
+        slapt_src_arena *arena = slapt_src_arena_init();
+        slapt_vector_t *sbs = slapt_src_get_slackbuilds_from_file(datafile, arena);
+        count = sbs->size;
+        slapt_vector_t_free(sbs);
+        arena_stats = *arena;
+        slapt_src_arena_free(arena);
+        iterations++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    const double mb = (double)st.st_size * iterations / (1024 * 1024);
+    printf("text parse: %.1f MB/s, %.3f ms per parse (%u slackbuilds, %d iterations)\n",
+           mb / elapsed, elapsed * 1000 / iterations, count, iterations);
+    printf("text parse arena: %zu chunks, %zu KiB, %zu strings interned, %zu reused\n",
+           arena_stats.chunk_count, arena_stats.bytes / 1024, arena_stats.interned, arena_stats.interned_hits);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        printf("text parse peak rss: %ld KiB\n", usage.ru_maxrss);
+
+    /* the same data through the binary catalog */
+    char tmpdir[] = "/tmp/slapt-src-bench-XXXXXX";
+    if (!catalog_create(datafile, tmpdir))
+        return EXIT_FAILURE;
+
+    iterations = 0;
+    const double catalog_start = now();
+    do {
+        slapt_src_catalog *catalog = slapt_src_get_available_slackbuilds();
+        count = catalog->slackbuilds->size;
+        slapt_src_catalog_free(catalog);
+        iterations++;
+        elapsed = now() - catalog_start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    printf("catalog load: %.3f ms per load (%u slackbuilds, %d iterations)\n",
+           elapsed * 1000 / iterations, count, iterations);
+
+    catalog_remove(tmpdir);
+    return EXIT_SUCCESS;
+}
+
+/* every field of every record against one term, the way a search without the index does */
+static uint32_t search_scan(const slapt_vector_t *sbs, const slapt_src_search_pattern *pattern)
+{
+    uint32_t matched = 0;
+    slapt_vector_t_foreach(const slapt_src_slackbuild *, sb, sbs) {
+        if (slapt_src_search_pattern_match(pattern, sb->name) ||
+            slapt_src_search_pattern_match(pattern, sb->location) ||
+            (sb->short_desc != NULL && slapt_src_search_pattern_match(pattern, sb->short_desc)))
+            matched++;
+    }
+    return matched;
+}
+
+static double search_time(const slapt_vector_t *sbs, const char *word, uint32_t flags, uint32_t *matched)
+{
+    slapt_src_search_pattern *pattern = slapt_src_search_pattern_init(word, flags);
+    int iterations = 0;
+    double elapsed = 0;
+    const double start = now();
+    do {
+        *matched = search_scan(sbs, pattern);
+        iterations++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_MIN_SECONDS / 4);
+    slapt_src_search_pattern_free(pattern);
+    return elapsed * 1000 / iterations;
+}
+
+static int bench_search(const char *datafile)
+{
+    char tmpdir[] = "/tmp/slapt-src-bench-XXXXXX";
+    if (!catalog_create(datafile, tmpdir))
+        return EXIT_FAILURE;
+
+    slapt_src_catalog *catalog = slapt_src_get_available_slackbuilds();
+    const char *words[] = {"python", "qt5", "perl", "library", "x", "PyQt", "ÉCOLE", "école"};
+    const uint32_t modes[] = {0, SLAPT_SRC_SEARCH_CASE_INSENSITIVE};
+
+    for (uint32_t m = 0; m < sizeof modes / sizeof modes[0]; m++) {
+        for (uint32_t w = 0; w < sizeof words / sizeof words[0]; w++) {
+            uint32_t literal_matched = 0, regex_matched = 0;
+            const double literal_ms = search_time(catalog->slackbuilds, words[w], modes[m], &literal_matched);
+            const double regex_ms = search_time(catalog->slackbuilds, words[w], modes[m] | SLAPT_SRC_SEARCH_REGEX, &regex_matched);
+            printf("search scan %s%s: literal %.3f ms, regex %.3f ms, %.1fx (%u matches%s)\n",
+                   words[w], modes[m] ? " (case insensitive)" : "", literal_ms, regex_ms, regex_ms / literal_ms,
+                   literal_matched, literal_matched == regex_matched ? "" : ", MISMATCH");
+            if (literal_matched != regex_matched) {
+                slapt_src_catalog_free(catalog);
+                catalog_remove(tmpdir);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    /* whole queries, through the index where it applies, have to find what a full regex scan does */
+    for (uint32_t m = 0; m < sizeof modes / sizeof modes[0]; m++) {
+        for (uint32_t w = 0; w < sizeof words / sizeof words[0]; w++) {
+            slapt_vector_t *names = slapt_vector_t_init(NULL);
+            slapt_vector_t_add(names, (void *)words[w]);
+            uint32_t count = 0, regex_matched = 0;
+            int iterations = 0;
+            double elapsed = 0;
+            const double start = now();
+            do {
+                slapt_vector_t *found = slapt_src_search_slackbuild_cache(catalog, names, modes[m]);
+                count = found->size;
+                slapt_vector_t_free(found);
+                iterations++;
+                elapsed = now() - start;
+            } while (elapsed < BENCH_MIN_SECONDS / 4);
+            slapt_vector_t_free(names);
+            search_time(catalog->slackbuilds, words[w], modes[m] | SLAPT_SRC_SEARCH_REGEX, &regex_matched);
+            printf("search query %s%s: %.3f ms (%u matches%s)\n",
+                   words[w], modes[m] ? " (case insensitive)" : "", elapsed * 1000 / iterations, count,
+                   count == regex_matched ? "" : ", MISMATCH");
+            if (count != regex_matched) {
+                slapt_src_catalog_free(catalog);
+                catalog_remove(tmpdir);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    slapt_src_catalog_free(catalog);
+    catalog_remove(tmpdir);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s parse|search\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* REG_ICASE folds beyond ascii in the user's locale, as it does for slapt-src */
+    setlocale(LC_ALL, "");
+
+    const char *data = getenv("SLAPT_SRC_BENCH_DATA");
+    if (data == NULL) {
+        printf("SLAPT_SRC_BENCH_DATA is not set, skipping\n");
+        return BENCH_SKIP;
+    }
+
+    char *datafile = realpath(data, NULL);
+    if (datafile == NULL) {
+        perror(data);
+        return EXIT_FAILURE;
+    }
+
+    int rv = EXIT_FAILURE;
+    if (strcmp(argv[1], "parse") == 0)
+        rv = bench_parse(datafile);
+    else if (strcmp(argv[1], "search") == 0)
+        rv = bench_search(datafile);
+    else
+        fprintf(stderr, "unknown benchmark: %s\n", argv[1]);
+
+    free(datafile);
+    return rv;
+}
@@ -17,12 +17,28 @@ ${slaptsrc} --config "${config}" --version
 ${slaptsrc} --config "${config}" --update
 ${slaptsrc} --config "${config}" --list
 ${slaptsrc} --config "${config}" --search test
+${slaptsrc} --config "${config}" --search TEST --case-insensitive
 ${slaptsrc} --config "${config}" --show z
 ${slaptsrc} --config "${config}" --upgrade-all -t
 ${slaptsrc} --config "${config}" --fetch z -t
 ${slaptsrc} --config "${config}" --build z -t
 ${slaptsrc} --config "${config}" --install z -t
+${slaptsrc} --config "${config}" --install z -t --jobs 4
+${slaptsrc} --config "${config}" --install z -t --stats
+${slaptsrc} --config "${config}" --list --stats=json 2>&1 >/dev/null | grep -q '"phase":"catalog"'
 ${slaptsrc} --config "${config}" --fetch z -y
 ${slaptsrc} --config "${config}" --clean
 
+fixture_config=${TEST_TMPDIR}/fixture_config
+cat > ${fixture_config} << EOF
+SOURCE=file://$(cd "$(dirname "${0}")" && pwd)/slackbuilds/
+BUILDDIR=${TEST_TMPDIR}/fixture
+EOF
+
+${slaptsrc} --config "${fixture_config}" --update
+# aa requires bb and a missing slackbuild, bb requires aa: neither installs, in either order
+if ${slaptsrc} --config "${fixture_config}" --install aa bb -t; then exit 1; fi
+if ${slaptsrc} --config "${fixture_config}" --install bb aa -t; then exit 1; fi
+${slaptsrc} --config "${fixture_config}" --install cc -t | grep -q "INSTALL: dd"
+
 find ${TEST_TMPDIR}